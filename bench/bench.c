@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "enumerate.h"
+#include "la.h"
+#include "parse.h"
+
+#ifndef BENCH_BUILD_TYPE
+#define BENCH_BUILD_TYPE ""
+#endif
+
+// runs every instance at thread counts 1..N, repeat times each, and writes a
+// json report. the reported time for a thread count is the median run; nodes
+// and lps come from the last run and do not depend on the thread count.
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+
+    return (x > y) - (x < y);
+}
+
+// writes text as a json string, quotes included
+static void write_json_string(FILE* dest, const char* text) {
+    fputc('"', dest);
+
+    for (const unsigned char* c = (const unsigned char*) text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(dest, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(dest, "\\u%04x", *c);
+        } else {
+            fputc(*c, dest);
+        }
+    }
+
+    fputc('"', dest);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-r repeat] [-t max_threads] [-o report.json] file...\n", name);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    long repeat = 3;
+    long thread_max = 0;
+    const char* report_path = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "r:t:o:")) != -1) {
+        switch (option) {
+            case 'r':
+                repeat = strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                thread_max = strtol(optarg, NULL, 10);
+                break;
+            case 'o':
+                report_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind == argc || repeat < 1) {
+        usage(argv[0]);
+    }
+
+    if (thread_max < 1) {
+        thread_max = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    FILE* report = report_path ? fopen(report_path, "w") : stdout;
+
+    if (!report) {
+        fprintf(stderr, "error opening file %s\n", report_path);
+        exit(1);
+    }
+
+    fprintf(report, "{\n");
+    fprintf(report, "  \"build_type\": \"%s\",\n", BENCH_BUILD_TYPE);
+    fprintf(report, "  \"processors\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(report, "  \"repeat\": %ld,\n", repeat);
+    fprintf(report, "  \"instances\": [");
+
+    double times[repeat];
+
+    for (int i = optind; i < argc; ++i) {
+        matrix_t* basis;
+        matrix_t* lower;
+        matrix_t* upper;
+        matrix_t* constraints;
+
+        if (!parse_file(argv[i], &basis, &lower, &upper, &constraints)) {
+            fprintf(stderr, "error parsing file %s\n", argv[i]);
+            exit(1);
+        }
+
+        fprintf(report, "%s\n    {\n", i == optind ? "" : ",");
+        fprintf(report, "      \"name\": ");
+        write_json_string(report, argv[i]);
+        fprintf(report, ",\n");
+        fprintf(report, "      \"dimensions\": %ld,\n", matrix_rows(basis));
+
+        double serial = 0;
+        long count = 0;
+
+        for (long threads = 1; threads <= thread_max; ++threads) {
+            enumerate_stats_t stats;
+            enumerate_options_t options;
+
+            enumerate_options_init(&options);
+            options.thread_max = threads;
+
+            for (long run = 0; run < repeat; ++run) {
+                struct timespec start;
+
+                count = 0;
+                stats.nodes = 0;
+                stats.lps = 0;
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                enumerate(basis, lower, upper, constraints, &count, NULL, NULL, &stats, &options);
+                times[run] = seconds_since(&start);
+
+                fprintf(stderr, "%s: threads %ld, run %ld: %.6fs\n", argv[i], threads, run + 1, times[run]);
+            }
+
+            qsort(times, repeat, sizeof(double), compare_double);
+
+            double wall = times[repeat / 2];
+
+            if (threads == 1) {
+                serial = wall;
+
+                fprintf(report, "      \"count\": %ld,\n", count);
+                fprintf(report, "      \"nodes\": %ld,\n", stats.nodes);
+                fprintf(report, "      \"lps\": %ld,\n", stats.lps);
+                fprintf(report, "      \"runs\": [");
+            }
+
+            fprintf(report, "%s\n        {", threads == 1 ? "" : ",");
+            fprintf(report, " \"threads\": %ld,", threads);
+            fprintf(report, " \"wall\": %.6f,", wall);
+            fprintf(report, " \"wall_min\": %.6f,", times[0]);
+            fprintf(report, " \"wall_max\": %.6f,", times[repeat - 1]);
+            fprintf(report, " \"nodes_per_sec\": %.1f,", stats.nodes / wall);
+            fprintf(report, " \"lps_per_sec\": %.1f,", stats.lps / wall);
+            fprintf(report, " \"speedup\": %.4f,", serial / wall);
+            fprintf(report, " \"efficiency\": %.4f", serial / wall / threads);
+            fprintf(report, " }");
+        }
+
+        fprintf(report, "\n      ]\n    }");
+
+        matrix_free(basis);
+        matrix_free(lower);
+        matrix_free(upper);
+
+        if (constraints) {
+            matrix_free(constraints);
+        }
+    }
+
+    fprintf(report, "\n  ]\n}\n");
+
+    if (report != stdout) {
+        fclose(report);
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "generate.h"
+#include "la.h"
+#include "parse.h"
+
+// writes a reproducible synthetic instance in the text or binary input format
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s -d dimensions [-b bits] [-n expected] [-s seed] [-f text|binary] [-o file]\n", name);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    unsigned long seed = 1;
+    long dimensions = 0;
+    long bits = 16;
+    long expected = 1000;
+    bool binary = false;
+    const char* path = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "d:b:n:s:f:o:")) != -1) {
+        switch (option) {
+            case 'd':
+                dimensions = strtol(optarg, NULL, 10);
+                break;
+            case 'b':
+                bits = strtol(optarg, NULL, 10);
+                break;
+            case 'n':
+                expected = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                if (strcmp(optarg, "text") != 0 && strcmp(optarg, "binary") != 0) {
+                    usage(argv[0]);
+                }
+
+                binary = strcmp(optarg, "binary") == 0;
+                break;
+            case 'o':
+                path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc || dimensions < 1 || bits < 1 || expected < 1) {
+        usage(argv[0]);
+    }
+
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, seed);
+
+    matrix_t* basis;
+    matrix_t* lower;
+    matrix_t* upper;
+
+    generate_instance(state, dimensions, bits, expected, &basis, &lower, &upper);
+
+    FILE* stream = path ? fopen(path, binary ? "wb" : "w") : stdout;
+
+    if (!stream || !(binary ? write_binary : write_text)(stream, basis, lower, upper, NULL) || (path && fclose(stream) != 0)) {
+        fprintf(stderr, "error writing file %s\n", path ? path : "(stdout)");
+        exit(1);
+    }
+
+    matrix_free(basis);
+    matrix_free(lower);
+    matrix_free(upper);
+
+    gmp_randclear(state);
+
+    return 0;
+}
@@ -0,0 +1,383 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "generate.h"
+#include "la.h"
+#include "lp.h"
+
+// times the hot kernels on synthetic instances from generate_instance() for
+// every combination of dimension and coefficient bit length, and writes a
+// json report. a kernel is rerun in batches until min_time has elapsed, and
+// only the kernel itself is inside the timed region.
+
+#define BATCH 16
+#define LIST_MAX 32
+
+typedef struct {
+    long dimensions;
+    const matrix_t* basis;
+    matrix_t* transform; // mpq_t[dimensions][dimensions]
+    matrix_t* offset;    // mpq_t[dimensions]
+    matrix_t* widths;    // mpq_t[dimensions], upper - lower
+    matrix_t* table;     // mpq_t[dimensions + 1][dimensions + 1]
+} instance_t;
+
+static double min_time = 0.2;
+static FILE* report;
+static bool first_record = true;
+
+static double seconds_between(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static long parse_list(const char* src, long* dest) {
+    long count = 0;
+    char* end;
+
+    while (*src && count < LIST_MAX) {
+        dest[count++] = strtol(src, &end, 10);
+        src = *end == ',' ? end + 1 : end;
+
+        if (end == src && *end) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+static void record(const char* kernel, const instance_t* instance, long bits, long depth, double seconds, long ops) {
+    fprintf(report, "%s\n    {", first_record ? "" : ",");
+    fprintf(report, " \"kernel\": \"%s\",", kernel);
+    fprintf(report, " \"dimensions\": %ld,", instance->dimensions);
+    fprintf(report, " \"bits\": %ld,", bits);
+    fprintf(report, " \"depth\": %ld,", depth);
+    fprintf(report, " \"ops\": %ld,", ops);
+    fprintf(report, " \"ns_per_op\": %.1f", seconds * 1e9 / ops);
+    fprintf(report, " }");
+
+    fprintf(stderr, "%-12s d=%-3ld bits=%-3ld depth=%-3ld %12.1f ns\n", kernel, instance->dimensions, bits, depth, seconds * 1e9 / ops);
+
+    first_record = false;
+}
+
+// same setup as enumerate(): transform = basis^-T, offset = basis^-T lower,
+// and the box widths that bound the search table's variables.
+static void instance_init(instance_t* instance, const matrix_t* basis, const matrix_t* lower, const matrix_t* upper) {
+    long dimensions = matrix_rows(basis);
+
+    instance->dimensions = dimensions;
+    instance->basis = basis;
+    instance->transform = matrix_alloc(dimensions, dimensions);
+    instance->offset = matrix_alloc(dimensions, 1);
+    instance->widths = matrix_alloc(dimensions, 1);
+    instance->table = matrix_alloc(dimensions + 1, dimensions + 1);
+
+    for (long i = 0; i < dimensions; ++i) {
+        mpq_set_ui(matrix_at(instance->transform, i, i), 1, 1);
+        mpq_set(matrix_at(instance->offset, i, 0), matrix_cat(lower, 0, i));
+    }
+
+    matrix_t* lu = matrix_dup(basis);
+    long pivots[dimensions];
+
+    matrix_lu(lu, pivots, 1);
+    solve_utltp(instance->transform, lu, pivots, 1);
+    solve_utltp(instance->offset, lu, pivots, 1);
+
+    matrix_free(lu);
+
+    for (long i = 0; i < dimensions; ++i) {
+        mpq_sub(matrix_at(instance->widths, i, 0), matrix_cat(upper, 0, i), matrix_cat(lower, 0, i));
+    }
+}
+
+static void instance_clear(instance_t* instance) {
+    matrix_free(instance->transform);
+    matrix_free(instance->offset);
+    matrix_free(instance->widths);
+    matrix_free(instance->table);
+}
+
+// fixes the first depth coordinates to their (fractional) values at the center
+// of the box, which keeps every fixed row feasible, and asks for the upper
+// bound of the next coordinate.
+static void instance_fix(instance_t* instance, long depth) {
+    long dimensions = instance->dimensions;
+
+    mpq_t t0;
+    mpq_t t1;
+
+    mpq_init(t0);
+    mpq_init(t1);
+
+    for (long row = 0; row < depth; ++row) {
+        mpq_set_ui(t0, 0, 1);
+
+        for (long col = 0; col < dimensions; ++col) {
+            mpq_mul(t1, matrix_cat(instance->transform, row, col), matrix_cat(instance->widths, col, 0));
+            mpq_add(t0, t0, t1);
+        }
+
+        mpq_div_2exp(t0, t0, 1);
+
+        for (long col = 0; col < dimensions; ++col) {
+            if (mpq_sgn(t0) > 0) {
+                mpq_set(matrix_at(instance->table, 1 + row, col), matrix_cat(instance->transform, row, col));
+            } else {
+                mpq_neg(matrix_at(instance->table, 1 + row, col), matrix_cat(instance->transform, row, col));
+            }
+        }
+
+        mpq_abs(matrix_at(instance->table, 1 + row, dimensions), t0);
+    }
+
+    for (long col = 0; col < dimensions; ++col) {
+        mpq_set(matrix_at(instance->table, 0, col), matrix_cat(instance->transform, depth < dimensions ? depth : 0, col));
+    }
+
+    mpq_clear(t0);
+    mpq_clear(t1);
+}
+
+static void bench_lu(const instance_t* instance, long bits) {
+    long dimensions = instance->dimensions;
+    long pivots[dimensions];
+
+    matrix_t* copies[BATCH];
+    matrix_t* rhs[BATCH];
+    double lu_seconds = 0;
+    double solve_seconds = 0;
+    long ops = 0;
+
+    while (lu_seconds + solve_seconds < min_time) {
+        struct timespec start;
+        struct timespec middle;
+        struct timespec end;
+
+        for (long i = 0; i < BATCH; ++i) {
+            copies[i] = matrix_dup(instance->basis);
+            rhs[i] = matrix_alloc(dimensions, dimensions);
+
+            for (long j = 0; j < dimensions; ++j) {
+                mpq_set_ui(matrix_at(rhs[i], j, j), 1, 1);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (long i = 0; i < BATCH; ++i) {
+            matrix_lu(copies[i], pivots, 1);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &middle);
+
+        for (long i = 0; i < BATCH; ++i) {
+            solve_utltp(rhs[i], copies[i], pivots, 1);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        lu_seconds += seconds_between(&start, &middle);
+        solve_seconds += seconds_between(&middle, &end);
+        ops += BATCH;
+
+        for (long i = 0; i < BATCH; ++i) {
+            matrix_free(copies[i]);
+            matrix_free(rhs[i]);
+        }
+    }
+
+    record("matrix_lu", instance, bits, 0, lu_seconds, ops);
+    record("solve_utltp", instance, bits, 0, solve_seconds, ops);
+}
+
+static void bench_lp_solve(instance_t* instance, long bits, long depth) {
+    matrix_t* x = matrix_alloc(instance->dimensions, 1);
+    double seconds = 0;
+    long ops = 0;
+
+    instance_fix(instance, depth);
+
+    while (seconds < min_time) {
+        struct timespec start;
+        struct timespec end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (long i = 0; i < BATCH; ++i) {
+            lp_solve(x, instance->table, instance->widths, instance->dimensions, 0, depth);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        seconds += seconds_between(&start, &end);
+        ops += BATCH;
+    }
+
+    record("lp_solve", instance, bits, depth, seconds, ops);
+
+    matrix_free(x);
+}
+
+// a pivot on the table with every coordinate fixed: the first column with a
+// nonzero in the first fixed row enters and that row leaves.
+static void bench_lp_pivot(instance_t* instance, long bits) {
+    long dimensions = instance->dimensions;
+
+    instance_fix(instance, dimensions);
+
+    long entering = 0;
+
+    while (entering < dimensions - 1 && mpq_sgn(matrix_cat(instance->table, 1, entering)) == 0) {
+        ++entering;
+    }
+
+    matrix_t* root = matrix_view(instance->table, 0, 0, 1 + dimensions, dimensions + 1);
+    matrix_t* copies[BATCH];
+    long B[dimensions];
+    long N[dimensions];
+    double seconds = 0;
+    long ops = 0;
+
+    while (seconds < min_time) {
+        struct timespec start;
+        struct timespec end;
+
+        for (long i = 0; i < BATCH; ++i) {
+            copies[i] = matrix_dup(root);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (long i = 0; i < BATCH; ++i) {
+            for (long j = 0; j < dimensions; ++j) {
+                N[j] = j;
+                B[j] = dimensions + j;
+            }
+
+            lp_pivot(copies[i], B, N, 2 * dimensions, dimensions, entering, 0);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        seconds += seconds_between(&start, &end);
+        ops += BATCH;
+
+        for (long i = 0; i < BATCH; ++i) {
+            matrix_free(copies[i]);
+        }
+    }
+
+    record("lp_pivot", instance, bits, 0, seconds, ops);
+
+    matrix_free(root);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-s seed] [-d dimensions,...] [-b bits,...] [-n expected] [-t min_time] [-o report.json]\n", name);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    unsigned long seed = 1;
+    long dimensions[LIST_MAX] = { 4, 8, 12, 16, 20 };
+    long dimensions_count = 5;
+    long bits[LIST_MAX] = { 8, 16, 32, 45 };
+    long bits_count = 4;
+    long expected = 1000;
+    const char* report_path = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:d:b:n:t:o:")) != -1) {
+        switch (option) {
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                dimensions_count = parse_list(optarg, dimensions);
+                break;
+            case 'b':
+                bits_count = parse_list(optarg, bits);
+                break;
+            case 'n':
+                expected = strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                min_time = strtod(optarg, NULL);
+                break;
+            case 'o':
+                report_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (optind != argc || expected < 1) {
+        usage(argv[0]);
+    }
+
+    report = report_path ? fopen(report_path, "w") : stdout;
+
+    if (!report) {
+        fprintf(stderr, "error opening file %s\n", report_path);
+        exit(1);
+    }
+
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, seed);
+
+    fprintf(report, "{\n");
+    fprintf(report, "  \"seed\": %lu,\n", seed);
+    fprintf(report, "  \"expected\": %ld,\n", expected);
+    fprintf(report, "  \"kernels\": [");
+
+    for (long i = 0; i < dimensions_count; ++i) {
+        for (long j = 0; j < bits_count; ++j) {
+            matrix_t* basis;
+            matrix_t* lower;
+            matrix_t* upper;
+            instance_t instance;
+
+            generate_instance(state, dimensions[i], bits[j], expected, &basis, &lower, &upper);
+            instance_init(&instance, basis, lower, upper);
+
+            bench_lu(&instance, bits[j]);
+            bench_lp_pivot(&instance, bits[j]);
+
+            for (long k = 0, depth = -1; k <= 4; ++k) {
+                long next = k == 4 ? dimensions[i] - 1 : dimensions[i] * k / 4;
+
+                if (next != depth) {
+                    depth = next;
+                    bench_lp_solve(&instance, bits[j], depth);
+                }
+            }
+
+            instance_clear(&instance);
+
+            matrix_free(basis);
+            matrix_free(lower);
+            matrix_free(upper);
+        }
+    }
+
+    fprintf(report, "\n  ]\n}\n");
+
+    if (report != stdout) {
+        fclose(report);
+    }
+
+    gmp_randclear(state);
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "affinity.h"
+
+bool affinity_parse(const char* spec, long** cpus_out, long* count_out) {
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return false;
+    }
+
+    long* cpus = malloc(CPU_SETSIZE * sizeof(long));
+    long count = 0;
+
+    if (strcmp(spec, "all") == 0) {
+        for (long cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus[count++] = cpu;
+            }
+        }
+    } else {
+        const char* pos = spec;
+
+        while (*pos) {
+            char* end;
+            long first = strtol(pos, &end, 10);
+            long last = first;
+
+            if (end == pos) {
+                free(cpus);
+                return false;
+            }
+
+            if (*end == '-') {
+                pos = end + 1;
+                last = strtol(pos, &end, 10);
+
+                if (end == pos) {
+                    free(cpus);
+                    return false;
+                }
+            }
+
+            if (first < 0 || last < first || last >= CPU_SETSIZE || count + last - first + 1 > CPU_SETSIZE) {
+                free(cpus);
+                return false;
+            }
+
+            // pinning to a cpu that is offline or outside the process's
+            // mask would fail and leave the worker floating
+            for (long cpu = first; cpu <= last; ++cpu) {
+                if (!CPU_ISSET(cpu, &set)) {
+                    free(cpus);
+                    return false;
+                }
+
+                cpus[count++] = cpu;
+            }
+
+            pos = *end == ',' ? end + 1 : end;
+
+            if (*end && *end != ',') {
+                free(cpus);
+                return false;
+            }
+        }
+    }
+
+    if (count == 0) {
+        free(cpus);
+        return false;
+    }
+
+    *cpus_out = cpus;
+    *count_out = count;
+
+    return true;
+}
+
+bool affinity_pin(long cpu) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
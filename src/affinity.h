@@ -0,0 +1,12 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+
+// spec is "all" for every cpu the process may run on, or a list such as
+// "0-11,24-35", every one of which the process must be allowed to run on.
+// the result is malloc'd.
+bool affinity_parse(const char* spec, long** cpus_out, long* count_out);
+
+// pins the calling thread to a single cpu
+bool affinity_pin(long cpu);
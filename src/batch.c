@@ -0,0 +1,369 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <gmp.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "enumerate.h"
+#include "la.h"
+#include "output.h"
+#include "parse.h"
+
+typedef struct {
+    char* const* paths;
+    long count;
+    long next;                  // first instance not yet claimed by a driver
+
+    const batch_options_t* batch;
+    const enumerate_options_t* options;
+    enumerate_pool_t* pool;
+    FILE* report;
+
+    pthread_mutex_t mutex;
+    long total;
+    bool success;
+} batch_t;
+
+static void push_path(char*** paths_out, long* count_out, char* path) {
+    *paths_out = realloc(*paths_out, (*count_out + 1) * sizeof(char*));
+    (*paths_out)[*count_out] = path;
+    *count_out += 1;
+}
+
+static char* join_path(const char* dir, size_t dir_length, const char* name, size_t name_length) {
+    char* path = malloc(dir_length + name_length + 2);
+
+    memcpy(path, dir, dir_length);
+    path[dir_length] = '/';
+    memcpy(path + dir_length + 1, name, name_length);
+    path[dir_length + 1 + name_length] = '\0';
+
+    return path;
+}
+
+static int compare_path(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static bool add_directory(const char* path, char*** paths_out, long* count_out) {
+    DIR* dir = opendir(path);
+
+    if (!dir) {
+        return false;
+    }
+
+    long first = *count_out;
+    struct dirent* entry;
+
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char* file = join_path(path, strlen(path), entry->d_name, strlen(entry->d_name));
+        struct stat info;
+
+        if (stat(file, &info) == 0 && S_ISREG(info.st_mode)) {
+            push_path(paths_out, count_out, file);
+        } else {
+            free(file);
+        }
+    }
+
+    closedir(dir);
+
+    qsort(*paths_out + first, *count_out - first, sizeof(char*), compare_path);
+
+    return true;
+}
+
+static bool add_manifest(const char* path, char*** paths_out, long* count_out) {
+    FILE* stream = fopen(path, "r");
+
+    if (!stream) {
+        return false;
+    }
+
+    const char* slash = strrchr(path, '/');
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &capacity, stream)) != -1) {
+        char* start = line;
+
+        while (*start == ' ' || *start == '\t') ++start;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) line[--length] = '\0';
+
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+
+        if (*start == '/' || !slash) {
+            push_path(paths_out, count_out, strdup(start));
+        } else {
+            push_path(paths_out, count_out, join_path(path, slash - path, start, strlen(start)));
+        }
+    }
+
+    free(line);
+
+    bool success = !ferror(stream);
+    fclose(stream);
+
+    return success;
+}
+
+bool batch_add(const char* path, bool manifest, char*** paths_out, long* count_out) {
+    if (manifest) {
+        return add_manifest(path, paths_out, count_out);
+    }
+
+    struct stat info;
+
+    if (stat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+        return add_directory(path, paths_out, count_out);
+    }
+
+    push_path(paths_out, count_out, strdup(path));
+
+    return true;
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static const char* file_name(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static int compare_name(const void* a, const void* b) {
+    return strcmp(file_name(*(char* const*) a), file_name(*(char* const*) b));
+}
+
+bool batch_check_names(char* const* paths, long count) {
+    char** sorted = malloc((count > 0 ? count : 1) * sizeof(char*));
+    memcpy(sorted, paths, count * sizeof(char*));
+    qsort(sorted, count, sizeof(char*), compare_name);
+
+    bool unique = true;
+
+    for (long i = 1; unique && i < count; ++i) {
+        if (compare_name(&sorted[i - 1], &sorted[i]) == 0) {
+            fprintf(stderr, "%s and %s would write the same results file\n", sorted[i - 1], sorted[i]);
+            unique = false;
+        }
+    }
+
+    free(sorted);
+
+    return unique;
+}
+
+// the results file of path, or NULL after reporting why it could not be opened
+static FILE* open_results(const batch_t* state, const char* path) {
+    const char* name = file_name(path);
+    const char* suffix = state->batch->format == OUTPUT_BINARY ? ".latr" : ".out";
+
+    size_t dir_length = strlen(state->batch->output_dir);
+    size_t name_length = strlen(name);
+    char* results_path = malloc(dir_length + name_length + strlen(suffix) + 2);
+
+    sprintf(results_path, "%s/%s%s", state->batch->output_dir, name, suffix);
+
+    FILE* stream = fopen(results_path, state->batch->format == OUTPUT_BINARY ? "wb" : "w");
+
+    if (!stream) {
+        fprintf(stderr, "%s: error opening results file %s\n", path, results_path);
+    }
+
+    free(results_path);
+
+    return stream;
+}
+
+// parses, searches and reports one instance. every failure is reported to
+// stderr and leaves the other instances running.
+static bool batch_instance(batch_t* state, const char* path) {
+    matrix_t* basis;
+    matrix_t* lower;
+    matrix_t* upper;
+    matrix_t* constraints;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!parse_file(path, &basis, &lower, &upper, &constraints)) {
+        fprintf(stderr, "error parsing file %s\n", path);
+        return false;
+    }
+
+    long dimensions = matrix_rows(basis);
+
+    enumerate_options_t options = *state->options;
+    matrix_t* objective = NULL;
+    mpq_t optimum;
+
+    mpq_init(optimum);
+    options.pool = state->pool;
+    options.objective = NULL;
+    options.optimum_out = NULL;
+
+    bool success = true;
+
+    if (state->batch->objective) {
+        objective = matrix_alloc(1, dimensions);
+
+        if (!parse_vector(state->batch->objective, objective)) {
+            fprintf(stderr, "%s: objective must have %ld rational coefficients\n", path, dimensions);
+            success = false;
+        } else if (state->batch->maximize) {
+            matrix_neg(objective, objective);
+        }
+
+        options.objective = objective;
+        options.optimum_out = optimum;
+    }
+
+    FILE* results_stream = NULL;
+
+    if (success && state->batch->format != OUTPUT_NONE) {
+        results_stream = open_results(state, path);
+        success = results_stream != NULL;
+    }
+
+    long count = 0;
+
+    if (success) {
+        double parse_seconds = seconds_since(&start);
+        output_t* output = output_alloc(results_stream, state->batch->format, dimensions);
+        lattice_t* lattice = lattice_prepare(basis, &options);
+
+        lattice_enumerate(lattice, lower, upper, constraints, &count, NULL, output, NULL);
+        lattice_free(lattice);
+
+        if (output) {
+            output_free(output);
+        }
+
+        if (results_stream && fclose(results_stream) != 0) {
+            fprintf(stderr, "%s: error writing results\n", path);
+            success = false;
+        }
+
+        double seconds = seconds_since(&start);
+
+        pthread_mutex_lock(&state->mutex);
+        state->total += count;
+
+        fprintf(state->report, "%s: count %ld, parse %.3fs, elapsed %.3fs", path, count, parse_seconds, seconds);
+
+        if (objective && count > 0) {
+            if (state->batch->maximize) {
+                mpq_neg(optimum, optimum);
+            }
+
+            fprintf(state->report, ", optimum ");
+            mpq_out_str(state->report, 10, optimum);
+        }
+
+        fprintf(state->report, "\n");
+        fflush(state->report);
+        pthread_mutex_unlock(&state->mutex);
+    }
+
+    if (objective) {
+        matrix_free(objective);
+    }
+
+    mpq_clear(optimum);
+
+    matrix_free(basis);
+    matrix_free(lower);
+    matrix_free(upper);
+
+    if (constraints) {
+        matrix_free(constraints);
+    }
+
+    return success;
+}
+
+static void* batch_driver(void* data) {
+    batch_t* state = data;
+
+    for (;;) {
+        pthread_mutex_lock(&state->mutex);
+        long index = state->next++;
+        pthread_mutex_unlock(&state->mutex);
+
+        if (index >= state->count) {
+            break;
+        }
+
+        if (!batch_instance(state, state->paths[index])) {
+            pthread_mutex_lock(&state->mutex);
+            state->success = false;
+            pthread_mutex_unlock(&state->mutex);
+        }
+    }
+
+    return NULL;
+}
+
+bool batch_run(char* const* paths, long count, const batch_options_t* batch, const enumerate_options_t* options, FILE* report, long* total_out) {
+    batch_t state;
+
+    state.paths = paths;
+    state.count = count;
+    state.next = 0;
+    state.batch = batch;
+    state.options = options;
+    state.pool = enumerate_pool_alloc(options);
+    state.report = report;
+    state.total = 0;
+    state.success = true;
+
+    pthread_mutex_init(&state.mutex, NULL);
+
+    // drivers mostly wait on their searches, whose workers come from the pool
+    long driver_count = options->thread_max < count ? options->thread_max : count;
+    pthread_t drivers[driver_count > 0 ? driver_count : 1];
+    bool started[driver_count > 0 ? driver_count : 1];
+    bool failed = false;
+
+    for (long i = 0; i < driver_count; ++i) {
+        started[i] = pthread_create(&drivers[i], NULL, batch_driver, &state) == 0;
+        failed = failed || !started[i];
+    }
+
+    // the caller claims the instances a missing driver would have
+    if (failed) {
+        batch_driver(&state);
+    }
+
+    for (long i = 0; i < driver_count; ++i) {
+        if (started[i]) {
+            pthread_join(drivers[i], NULL);
+        }
+    }
+
+    pthread_mutex_destroy(&state.mutex);
+    enumerate_pool_free(state.pool);
+
+    *total_out += state.total;
+
+    return state.success;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "enumerate.h"
+#include "output.h"
+
+typedef struct {
+    output_format_t format;
+    const char* output_dir; // results of dir/name go to output_dir/name.out (.latr if binary)
+    const char* objective;  // "c1 c2 ...", parsed per instance, or NULL
+    bool maximize;
+} batch_options_t;
+
+// appends path to *paths_out, or every regular file in it if it is a
+// directory, or every path listed in it (one per line, relative to the
+// manifest's directory) if manifest is set. the paths are malloc'd.
+bool batch_add(const char* path, bool manifest, char*** paths_out, long* count_out);
+
+// results are named by file name alone, so two paths sharing one would write
+// the same results file. returns false, after reporting the first such pair
+// to stderr, if any do.
+bool batch_check_names(char* const* paths, long count);
+
+// runs the instances on one pool of options->thread_max workers, parsing and
+// searching up to thread_max of them at once, and writes a line per instance
+// to report as it finishes. returns false if any instance failed.
+bool batch_run(char* const* paths, long count, const batch_options_t* batch, const enumerate_options_t* options, FILE* report, long* total_out);
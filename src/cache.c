@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "cache.h"
+#include "parse.h"
+
+#define CACHE_MAGIC   "LATC"
+#define CACHE_VERSION 1
+
+// header, followed by the basis (dimensions * dimensions entries, to rule
+// out hash collisions), dimensions int64_t pivots, the lu factors and the
+// transform (dimensions * dimensions entries each)
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t limb_bits;
+    uint32_t reserved;
+    int64_t dimensions;
+    uint64_t hash;
+} cache_header_t;
+
+// fnv-1a over the binary encoding of the basis
+static uint64_t basis_hash(const matrix_t* basis) {
+    char* data = NULL;
+    size_t size = 0;
+    FILE* stream = open_memstream(&data, &size);
+    long dimensions = matrix_rows(basis);
+
+    for (long row = 0; row < dimensions; ++row) {
+        for (long col = 0; col < dimensions; ++col) {
+            write_binary_rational(stream, matrix_cat(basis, row, col));
+        }
+    }
+
+    fclose(stream);
+
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ull;
+    }
+
+    free(data);
+
+    return hash;
+}
+
+static char* entry_path(const char* dir, uint64_t hash, const char* suffix) {
+    size_t length = strlen(dir) + 32 + strlen(suffix);
+    char* path = malloc(length);
+
+    snprintf(path, length, "%s/%016llx.latc%s", dir, (unsigned long long) hash, suffix);
+
+    return path;
+}
+
+static bool read_matrix(const char** pos, const char* end, matrix_t* dest) {
+    for (long row = 0; row < matrix_rows(dest); ++row) {
+        for (long col = 0; col < matrix_cols(dest); ++col) {
+            if (!read_binary_rational(pos, end, matrix_at(dest, row, col))) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// an entry that matches its header and basis can still hold damaged factors,
+// so they must be what matrix_lu() and solve_utltp() would have produced:
+// nonzero pivots on the diagonal of lu and a transform with basis transform^T = 1
+static bool check_entry(const matrix_t* basis, const matrix_t* lu, const matrix_t* transform) {
+    long dimensions = matrix_rows(basis);
+    bool success = true;
+
+    for (long i = 0; success && i < dimensions; ++i) {
+        success = mpq_sgn(matrix_cat(lu, i, i)) != 0;
+    }
+
+    mpq_t sum;
+    mpq_t product;
+
+    mpq_init(sum);
+    mpq_init(product);
+
+    for (long row = 0; success && row < dimensions; ++row) {
+        for (long col = 0; success && col < dimensions; ++col) {
+            mpq_set_ui(sum, 0, 1);
+
+            for (long k = 0; k < dimensions; ++k) {
+                mpq_mul(product, matrix_cat(basis, row, k), matrix_cat(transform, col, k));
+                mpq_add(sum, sum, product);
+            }
+
+            success = row == col ? mpq_cmp_ui(sum, 1, 1) == 0 : mpq_sgn(sum) == 0;
+        }
+    }
+
+    mpq_clear(sum);
+    mpq_clear(product);
+
+    return success;
+}
+
+static bool read_entry(const char* data, size_t size, const matrix_t* basis, uint64_t hash, matrix_t* lu, long* pivots, matrix_t* transform) {
+    long dimensions = matrix_rows(basis);
+    cache_header_t header;
+
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, CACHE_MAGIC, 4) != 0 || header.version != CACHE_VERSION || header.limb_bits != 8 * sizeof(mp_limb_t) || header.dimensions != dimensions || header.hash != hash) {
+        return false;
+    }
+
+    const char* pos = data + sizeof(header);
+    const char* end = data + size;
+
+    matrix_t* stored = matrix_alloc(dimensions, dimensions);
+    bool success = read_matrix(&pos, end, stored);
+
+    for (long row = 0; success && row < dimensions; ++row) {
+        for (long col = 0; success && col < dimensions; ++col) {
+            success = mpq_equal(matrix_cat(stored, row, col), matrix_cat(basis, row, col));
+        }
+    }
+
+    matrix_free(stored);
+
+    if (!success || (size_t) (end - pos) < dimensions * sizeof(int64_t)) {
+        return false;
+    }
+
+    for (long i = 0; i < dimensions; ++i) {
+        int64_t pivot;
+        memcpy(&pivot, pos, sizeof(pivot));
+        pos += sizeof(pivot);
+
+        // row i is swapped with itself or a row below it, so the swaps make a
+        // permutation
+        if (pivot < i || pivot >= dimensions) {
+            return false;
+        }
+
+        pivots[i] = pivot;
+    }
+
+    return read_matrix(&pos, end, lu) && read_matrix(&pos, end, transform) && pos == end && check_entry(basis, lu, transform);
+}
+
+bool cache_load(const char* dir, const matrix_t* basis, matrix_t* lu, long* pivots, matrix_t* transform) {
+    uint64_t hash = basis_hash(basis);
+    char* path = entry_path(dir, hash, "");
+    int fd = open(path, O_RDONLY);
+
+    free(path);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    bool success = read_entry(data, info.st_size, basis, hash, lu, pivots, transform);
+    munmap(data, info.st_size);
+
+    return success;
+}
+
+static void write_matrix(FILE* stream, const matrix_t* src) {
+    for (long row = 0; row < matrix_rows(src); ++row) {
+        for (long col = 0; col < matrix_cols(src); ++col) {
+            write_binary_rational(stream, matrix_cat(src, row, col));
+        }
+    }
+}
+
+// written under a unique temporary name and renamed over the entry, so a
+// concurrent reader sees the old entry or the new one, never a torn file
+bool cache_store(const char* dir, const matrix_t* basis, const matrix_t* lu, const long* pivots, const matrix_t* transform) {
+    long dimensions = matrix_rows(basis);
+    uint64_t hash = basis_hash(basis);
+
+    char* path = entry_path(dir, hash, "");
+    char* temp_path = entry_path(dir, hash, ".XXXXXX");
+    int fd = mkstemp(temp_path);
+    FILE* stream = fd == -1 ? NULL : fdopen(fd, "wb");
+    bool success = stream != NULL;
+
+    if (fd != -1 && !stream) {
+        close(fd);
+        unlink(temp_path);
+    }
+
+    if (success) {
+        cache_header_t header = { CACHE_MAGIC, CACHE_VERSION, 8 * sizeof(mp_limb_t), 0, dimensions, hash };
+
+        fwrite(&header, sizeof(header), 1, stream);
+        write_matrix(stream, basis);
+
+        for (long i = 0; i < dimensions; ++i) {
+            int64_t pivot = pivots[i];
+            fwrite(&pivot, sizeof(pivot), 1, stream);
+        }
+
+        write_matrix(stream, lu);
+        write_matrix(stream, transform);
+
+        success = !ferror(stream);
+        success = fclose(stream) == 0 && success;
+        success = success && rename(temp_path, path) == 0;
+
+        if (!success) {
+            unlink(temp_path);
+        }
+    }
+
+    free(path);
+    free(temp_path);
+
+    return success;
+}
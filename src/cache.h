@@ -0,0 +1,17 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+
+#include "la.h"
+
+// the factored basis that lattice_prepare() computes, kept in dir as one file
+// per basis, named by a hash of it. entries use the binary input format's
+// encoding of rationals and are read straight from a mapping of the file.
+
+// fills lu, pivots and transform from the entry for basis, if dir holds one
+// whose basis matches exactly and whose factors invert it
+bool cache_load(const char* dir, const matrix_t* basis, matrix_t* lu, long* pivots, matrix_t* transform);
+
+// writes the entry for basis, replacing any entry of the same name at once
+bool cache_store(const char* dir, const matrix_t* basis, const matrix_t* lu, const long* pivots, const matrix_t* transform);
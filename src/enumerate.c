@@ -1,55 +1,191 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 #include <pthread.h>
+#include <semaphore.h>
 
+#include "affinity.h"
+#include "cache.h"
+#include "enumerate.h"
 #include "la.h"
 #include "lp.h"
+#include "numstats.h"
+#include "output.h"
+#include "trace.h"
+
+// worker bookkeeping, shared by every search started on the pool
+struct enumerate_pool_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t finished;
+    volatile long thread_count;
+    long thread_max;
+    bool* slots;               // bool[thread_max]
+    const long* cpus;
+    long cpu_count;
+    bool numa_local;
+};
+
+// a factored basis, kept across queries
+struct lattice_s {
+    long dimensions;
+    matrix_t* basis;           // mpq_t[dimensions][dimensions]
+    matrix_t* lu;              // mpq_t[dimensions][dimensions], matrix_lu() of basis
+    long* pivots;              // long[dimensions]
+    matrix_t* transform;       // mpq_t[dimensions][dimensions], basis^-T
+    long la_threads;           // threads of the factorization and of each query's solve
+
+    matrix_t* objective;       // mpq_t[dimensions], or NULL
+    matrix_t* objective_c;     // mpq_t[dimensions], basis objective
+    mpq_ptr optimum_out;
+
+    enumerate_pool_t* pool;
+    bool own_pool;             // pool was allocated by lattice_prepare()
+    long presolve_depth;
+    long cut_depth;
+
+    // coefficients and coordinates fall into blocks when the transform is
+    // block diagonal up to permutation, and each block is then a lattice of
+    // its own. block_count is 1 and the rest NULL otherwise.
+    long block_count;
+    long* row_block;           // long[dimensions], block of each coefficient
+    long* col_block;           // long[dimensions], block of each coordinate
+    lattice_t** blocks;        // lattice_t*[block_count]
+};
+
+typedef struct {
+    bool found;
+    mpq_t value;
+    matrix_t* point; // mpq_t[dimensions]
+} incumbent_t;
 
 typedef struct {
     long dimensions;
     long depth;
+    long inequalities;         // constraint rows and presolve rows, ahead of the fixed rows
+    long presolve_depth;       // nodes above this depth bound every later coefficient
+    long cut_depth;            // nodes above this depth add gomory cuts
 
     const matrix_t* transform; // mpq_t[dimensions][2 * dimensions]
     const matrix_t* offset;    // mpq_t[dimensions]
+    const matrix_t* widths;    // mpq_t[dimensions], upper - lower, the bounds of x
+    matrix_t* forms;           // mpq_t[dimensions][dimensions + 1], transform and offset, if cutting
     matrix_t* fixed;           // mpq_t[dimensions]
 
-    matrix_t* table;           // mpq_t[2 * dimensions][3 * dimensions]
+    matrix_t* table;           // mpq_t[1 + inequalities + dimensions][dimensions + 1]
     matrix_t* x;               // mpq_t[2 * dimensions]
 
+    long count;                // found by this thread, merged into *count_out on exit
     long* count_out;
-    matrix_t*** results_out;  // mpq_t[*count_out][dimensions]
+    enumerate_stats_t stats;   // merged into *stats_out on exit
+    enumerate_stats_t* stats_out;
+    matrix_t*** results_out;  // mpq_t[*results_count][dimensions], or NULL
+    long* results_count;
+    output_t* output;
 
     pthread_mutex_t *mutex;
     pthread_cond_t *finished;
     volatile long* thread_count;
     long thread_max;
+    volatile long* active;     // workers running this search, as opposed to the whole pool
+
+    const matrix_t* objective;    // mpq_t[dimensions], minimized over x, or NULL
+    const matrix_t* objective_c;  // mpq_t[dimensions], the objective over the coefficients
+    mpq_srcptr objective_offset;  // objective at x = 0
+    incumbent_t* incumbent;
+
+    const matrix_t* basis;     // mpq_t[dimensions][dimensions], rows are the basis vectors
+    lattice_box_t* boxes;      // boxes sharing this search, each receiving the points it contains, or NULL
+    long box_count;
+    long* box_counts;          // long[box_count], found by this thread, merged on exit
+    long* box_results;         // long[box_count], results stored so far per box
+    matrix_t* point;           // mpq_t[dimensions], lattice point of the current leaf
+
+    // a box symmetric about the origin, without constraints or an objective,
+    // holds -c with every c, so only c whose first nonzero is positive (and
+    // 0) are searched, and the others are reported as their mirror images
+    bool symmetric;
+    matrix_t* mirror;          // mpq_t[dimensions], if symmetric
+
+    // only the count is wanted, so the last two coefficients are counted in
+    // closed form instead of being searched
+    bool counting;
+
+    long slot;                 // index of this worker in slots
+    bool* slots;               // bool[thread_max], true while a worker holds the slot
+    const long* cpus;          // slot i is pinned to cpus[i % cpu_count], or NULL
+    long cpu_count;
+    bool numa_local;
 } search_info_t;
 
+// a new worker either receives a copy made by its parent, or, with numa_local,
+// makes the copy itself after pinning so that the first touch of its tableau
+// memory happens on its own node. the parent waits on copied in that case.
+typedef struct {
+    search_info_t* info;
+    const search_info_t* src;
+    long slot;
+    sem_t copied;
+} spawn_t;
+
 static search_info_t *search_info_dup(const search_info_t* src) {
     search_info_t* dest = malloc(sizeof(search_info_t));
 
     dest->dimensions = src->dimensions;
     dest->depth = src->depth;
+    dest->inequalities = src->inequalities;
+    dest->presolve_depth = src->presolve_depth;
+    dest->cut_depth = src->cut_depth;
 
     dest->transform = src->transform;
     dest->offset = src->offset;
+    dest->widths = src->widths;
+    dest->forms = src->forms;
     dest->fixed = matrix_dup(src->fixed);
 
     dest->table = matrix_dup(src->table);
     dest->x = matrix_dup(src->x);
 
+    dest->count = 0;
     dest->count_out = src->count_out;
+    dest->stats.nodes = 0;
+    dest->stats.lps = 0;
+    dest->stats_out = src->stats_out;
     dest->results_out = src->results_out;
+    dest->results_count = src->results_count;
+    dest->output = src->output;
 
     dest->mutex = src->mutex;
     dest->finished = src->finished;
     dest->thread_count = src->thread_count;
     dest->thread_max = src->thread_max;
+    dest->active = src->active;
+
+    dest->objective = src->objective;
+    dest->objective_c = src->objective_c;
+    dest->objective_offset = src->objective_offset;
+    dest->incumbent = src->incumbent;
+
+    dest->basis = src->basis;
+    dest->boxes = src->boxes;
+    dest->box_count = src->box_count;
+    dest->box_counts = src->boxes ? calloc(src->box_count, sizeof(long)) : NULL;
+    dest->box_results = src->box_results;
+    dest->point = src->boxes ? matrix_alloc(src->dimensions, 1) : NULL;
+    dest->symmetric = src->symmetric;
+    dest->mirror = src->symmetric ? matrix_alloc(src->dimensions, 1) : NULL;
+    dest->counting = src->counting;
+
+    dest->slot = src->slot;
+    dest->slots = src->slots;
+    dest->cpus = src->cpus;
+    dest->cpu_count = src->cpu_count;
+    dest->numa_local = src->numa_local;
 
     return dest;
 }
@@ -59,208 +195,2297 @@ static void search_info_free(search_info_t* src) {
     matrix_free(src->table);
     matrix_free(src->x);
 
+    if (src->point) {
+        free(src->box_counts);
+        matrix_free(src->point);
+    }
+
+    if (src->mirror) {
+        matrix_free(src->mirror);
+    }
+
     free(src);
 }
 
+// counts past LONG_MAX cannot be reported, so the search stops rather than
+// wrap around
+static void count_overflow(void) {
+    fprintf(stderr, "lattice point count overflows a long\n");
+    abort();
+}
+
+static void count_add(long* dest, long value) {
+    if (__builtin_add_overflow(*dest, value, dest)) {
+        count_overflow();
+    }
+}
+
 static void* search_thread(void*);
 
-static void search(search_info_t *info) {
-    if (info->depth == info->dimensions) {
+// claims a free slot if fewer than thread_max workers are running, and starts
+// a worker on a copy of info. returns false if the caller should continue
+// the search itself, which includes a worker that could not be started.
+static bool search_spawn(search_info_t* info) {
+    pthread_mutex_lock(info->mutex);
+
+    if (*info->thread_count >= info->thread_max) {
+        pthread_mutex_unlock(info->mutex);
+        return false;
+    }
+
+    long slot = 0;
+
+    while (info->slots[slot]) {
+        ++slot;
+    }
+
+    info->slots[slot] = true;
+    *info->thread_count += 1;
+    *info->active += 1;
+    pthread_mutex_unlock(info->mutex);
+
+    pthread_t thread;
+    bool started;
+
+    if (info->numa_local) {
+        spawn_t spawn;
+
+        spawn.info = NULL;
+        spawn.src = info;
+        spawn.slot = slot;
+        sem_init(&spawn.copied, 0, 0);
+
+        started = pthread_create(&thread, NULL, search_thread, &spawn) == 0;
+
+        if (started) {
+            pthread_detach(thread);
+
+            while (sem_wait(&spawn.copied) != 0) {
+                //
+            }
+        }
+
+        sem_destroy(&spawn.copied);
+    } else {
+        spawn_t* spawn = malloc(sizeof(spawn_t));
+
+        spawn->info = search_info_dup(info);
+        spawn->src = NULL;
+        spawn->slot = slot;
+
+        started = pthread_create(&thread, NULL, search_thread, spawn) == 0;
+
+        if (started) {
+            pthread_detach(thread);
+        } else {
+            search_info_free(spawn->info);
+            free(spawn);
+        }
+    }
+
+    if (!started) {
         pthread_mutex_lock(info->mutex);
+        info->slots[slot] = false;
+        *info->thread_count -= 1;
+        *info->active -= 1;
+        pthread_cond_broadcast(info->finished);
+        pthread_mutex_unlock(info->mutex);
+    }
+
+    return started;
+}
+
+static void search(search_info_t *info);
 
-        printf("found: ");
-        matrix_print_t(stdout, info->fixed);
-        printf("\n");
+static void search_leaf(search_info_t* info) {
+    long start = trace_begin();
 
-        *info->count_out += 1;
-        *info->results_out = realloc(*info->results_out, *info->count_out * sizeof(matrix_t*));
-        (*info->results_out)[*info->count_out - 1] = matrix_dup(info->fixed);
+    info->count += 1;
+
+    if (info->output) {
+        output_point(info->output, info->fixed);
+    }
+
+    if (info->results_out) {
+        matrix_t* result = matrix_dup(info->fixed);
+
+        pthread_mutex_lock(info->mutex);
+
+        *info->results_out = realloc(*info->results_out, (*info->results_count + 1) * sizeof(matrix_t*));
+        (*info->results_out)[*info->results_count] = result;
+        *info->results_count += 1;
 
         pthread_mutex_unlock(info->mutex);
-    } else {
-        mpq_t t0;
-        mpq_t t1;
-        mpq_t t2;
-        mpz_t min;
-        mpz_t max;
-
-        mpq_init(t0);
-        mpq_init(t1);
-        mpq_init(t2);
-        mpz_init(min);
-        mpz_init(max);
-
-        // lower bound
-        for (long col = 0; col < info->dimensions; ++col) {
-            mpq_neg(matrix_at(info->table, 0, col), matrix_cat(info->transform, info->depth, col));
+    }
+
+    trace_end("emit", start, info->depth, info->fixed);
+}
+
+// reports point and the count - 1 points after it along the last coefficient
+static void search_report_range(search_info_t* info, matrix_t* point, unsigned long count) {
+    if (info->output) {
+        output_range(info->output, point, count - 1);
+    }
+
+    if (info->results_out) {
+        mpq_ptr last = matrix_at(point, info->dimensions - 1, 0);
+        matrix_t** results = malloc(count * sizeof(matrix_t*));
+
+        for (unsigned long i = 0; i < count; ++i) {
+            results[i] = matrix_dup(point);
+            mpz_add_ui(mpq_numref(last), mpq_numref(last), 1);
         }
 
-        lp_solve(info->x, info->table, info->dimensions, info->depth);
+        pthread_mutex_lock(info->mutex);
+
+        *info->results_out = realloc(*info->results_out, (*info->results_count + count) * sizeof(matrix_t*));
+        memcpy(*info->results_out + *info->results_count, results, count * sizeof(matrix_t*));
+        *info->results_count += count;
 
-        mpq_set(t0, matrix_cat(info->offset, info->depth, 0));
+        pthread_mutex_unlock(info->mutex);
 
-        for (long col = 0; col < info->dimensions; ++col) {
-            mpq_mul(t1, matrix_cat(info->transform, info->depth, col), matrix_cat(info->x, col, 0));
-            mpq_add(t0, t0, t1);
+        free(results);
+    }
+}
+
+// true if every fixed coefficient is zero, so that the node's slice of a
+// symmetric box is symmetric too
+static bool search_zero_prefix(const search_info_t* info) {
+    for (long row = 0; row < info->depth; ++row) {
+        if (mpq_sgn(matrix_cat(info->fixed, row, 0)) != 0) {
+            return false;
         }
+    }
 
-        mpz_cdiv_q(min, mpq_numref(t0), mpq_denref(t0));
-        mpq_set(t2, t0);
+    return true;
+}
 
-        // upper bound
-        for (long col = 0; col < info->dimensions; ++col) {
-            mpq_set(matrix_at(info->table, 0, col), matrix_cat(info->transform, info->depth, col));
+// every integer in [min, max] completes the fixed coefficients to a point, so
+// the last level reports them as one range rather than a leaf each. in a
+// symmetric search a nonzero prefix stands for its mirror image as well.
+static void search_leaf_range(search_info_t* info, mpz_srcptr min, mpz_srcptr max) {
+    if (mpz_cmp(min, max) > 0) {
+        return;
+    }
+
+    mpz_t width;
+    mpz_init(width);
+    mpz_sub(width, max, min);
+
+    unsigned long count = mpz_get_ui(width) + 1;
+    mpz_clear(width);
+
+    long start = trace_begin();
+    mpq_ptr last = matrix_at(info->fixed, info->depth, 0);
+    bool mirrored = info->symmetric && !search_zero_prefix(info);
+
+    info->count += mirrored ? 2 * count : count;
+    info->stats.nodes += count;
+
+    mpq_set_z(last, min);
+    search_report_range(info, info->fixed, count);
+
+    if (mirrored) {
+        mpq_set_z(last, max);
+        matrix_neg(info->mirror, info->fixed);
+        search_report_range(info, info->mirror, count);
+    }
+
+    trace_end("emit", start, info->depth, info->fixed);
+}
+
+// sum of floor((a i + b) / m) over 0 <= i < n, for m > 0. each step reduces a
+// and b below m and then swaps the roles of a and m, as in euclid's
+// algorithm, so it takes logarithmically many steps however large n is.
+static void floor_sum(mpz_ptr sum, mpz_srcptr n, mpz_srcptr m, mpz_srcptr a, mpz_srcptr b) {
+    mpz_t n_;
+    mpz_t m_;
+    mpz_t a_;
+    mpz_t b_;
+    mpz_t q;
+    mpz_t t;
+
+    mpz_init_set(n_, n);
+    mpz_init_set(m_, m);
+    mpz_init_set(a_, a);
+    mpz_init_set(b_, b);
+    mpz_init(q);
+    mpz_init(t);
+
+    mpz_set_ui(sum, 0);
+
+    for (;;) {
+        // sum += floor(a / m) n (n - 1) / 2 + floor(b / m) n
+        mpz_fdiv_qr(q, a_, a_, m_);
+        mpz_sub_ui(t, n_, 1);
+        mpz_mul(t, t, n_);
+        mpz_divexact_ui(t, t, 2);
+        mpz_addmul(sum, t, q);
+
+        mpz_fdiv_qr(q, b_, b_, m_);
+        mpz_addmul(sum, q, n_);
+
+        // what is left counts the lattice points under the line, which is
+        // the same sum with the axes swapped
+        mpz_mul(t, a_, n_);
+        mpz_add(t, t, b_);
+
+        if (mpz_cmp(t, m_) < 0) {
+            break;
         }
 
-        lp_solve(info->x, info->table, info->dimensions, info->depth);
+        mpz_fdiv_qr(n_, b_, t, m_);
+        mpz_swap(m_, a_);
+    }
 
-        mpq_set(t0, matrix_cat(info->offset, info->depth, 0));
+    mpz_clear(n_);
+    mpz_clear(m_);
+    mpz_clear(a_);
+    mpz_clear(b_);
+    mpz_clear(q);
+    mpz_clear(t);
+}
 
-        for (long col = 0; col < info->dimensions; ++col) {
-            mpq_mul(t1, matrix_cat(info->transform, info->depth, col), matrix_cat(info->x, col, 0));
-            mpq_add(t0, t0, t1);
+// sum over the integers u in [min, max] of floor(v), where v is the lowest of
+// the lines v = slope u + intercept given as the rows of lines. going right,
+// the lowest line only ever gives way to one of smaller slope, so the sum
+// splits into at most count pieces, each one floor_sum().
+static void floor_sum_envelope(mpz_ptr sum, const matrix_t* lines, long count, mpz_srcptr min, mpz_srcptr max) {
+    mpq_t value;
+    mpq_t lowest;
+    mpq_t crossing;
+    mpq_t next_crossing;
+    mpz_t lo;
+    mpz_t hi;
+    mpz_t n;
+    mpz_t m;
+    mpz_t a;
+    mpz_t b;
+    mpz_t piece;
+
+    mpq_init(value);
+    mpq_init(lowest);
+    mpq_init(crossing);
+    mpq_init(next_crossing);
+    mpz_init_set(lo, min);
+    mpz_init(hi);
+    mpz_init(n);
+    mpz_init(m);
+    mpz_init(a);
+    mpz_init(b);
+    mpz_init(piece);
+
+    mpz_set_ui(sum, 0);
+
+    // lowest line at min, the one of smaller slope on a tie
+    long active = -1;
+    mpq_set_z(crossing, min);
+
+    for (long i = 0; i < count; ++i) {
+        mpq_mul(value, matrix_cat(lines, i, 0), crossing);
+        mpq_add(value, value, matrix_cat(lines, i, 1));
+
+        int order = active == -1 ? -1 : mpq_cmp(value, lowest);
+
+        if (order < 0 || (order == 0 && mpq_cmp(matrix_cat(lines, i, 0), matrix_cat(lines, active, 0)) < 0)) {
+            active = i;
+            mpq_set(lowest, value);
         }
+    }
 
-        mpz_fdiv_q(max, mpq_numref(t0), mpq_denref(t0));
+    for (;;) {
+        mpq_srcptr slope = matrix_cat(lines, active, 0);
+        mpq_srcptr intercept = matrix_cat(lines, active, 1);
 
-        // rhs of new row = offset - x
-        mpq_set_z(t0, min);
-        mpq_sub(t0, matrix_cat(info->offset, info->depth, 0), t0);
+        // the first line of smaller slope to cross the active one
+        long next = -1;
 
-        // min <= max, min += 1, rhs -= 1
-        for (; mpz_cmp(min, max) <= 0; mpz_add_ui(min, min, 1), mpz_sub(mpq_numref(t0), mpq_numref(t0), mpq_denref(t0))) {
-            if (mpq_sgn(t0) >= 0) {
-                for (long col = 0; col < info->dimensions; ++col) {
-                    mpq_neg(matrix_at(info->table, 1 + info->dimensions + info->depth, col), matrix_cat(info->transform, info->depth, col));
-                }
+        for (long i = 0; i < count; ++i) {
+            if (mpq_cmp(matrix_cat(lines, i, 0), slope) >= 0) {
+                continue;
+            }
 
-                mpq_set(matrix_at(info->table, 1 + info->dimensions + info->depth, info->dimensions), t0);
-            } else {
-                for (long col = 0; col < info->dimensions; ++col) {
-                    mpq_set(matrix_at(info->table, 1 + info->dimensions + info->depth, col), matrix_cat(info->transform, info->depth, col));
-                }
+            mpq_sub(crossing, matrix_cat(lines, i, 1), intercept);
+            mpq_sub(value, slope, matrix_cat(lines, i, 0));
+            mpq_div(crossing, crossing, value);
+
+            int order = next == -1 ? -1 : mpq_cmp(crossing, next_crossing);
+
+            if (order < 0 || (order == 0 && mpq_cmp(matrix_cat(lines, i, 0), matrix_cat(lines, next, 0)) < 0)) {
+                next = i;
+                mpq_set(next_crossing, crossing);
+            }
+        }
+
+        mpz_set(hi, max);
+
+        if (next != -1) {
+            mpz_fdiv_q(b, mpq_numref(next_crossing), mpq_denref(next_crossing));
 
-                mpq_neg(matrix_at(info->table, 1 + info->dimensions + info->depth, info->dimensions), t0);
+            if (mpz_cmp(b, hi) < 0) {
+                mpz_set(hi, b);
             }
+        }
 
-            mpq_set_z(matrix_at(info->fixed, info->depth, 0), min);
-            info->depth += 1;
+        // floor((p u + q) / r) with u = lo + i, for slope p / r and intercept q / r
+        if (mpz_cmp(lo, hi) <= 0) {
+            mpz_sub(n, hi, lo);
+            mpz_add_ui(n, n, 1);
+            mpz_mul(m, mpq_denref(slope), mpq_denref(intercept));
+            mpz_mul(a, mpq_numref(slope), mpq_denref(intercept));
+            mpz_mul(b, mpq_numref(intercept), mpq_denref(slope));
+            mpz_addmul(b, a, lo);
+
+            floor_sum(piece, n, m, a, b);
+            mpz_add(sum, sum, piece);
+        }
 
-            pthread_mutex_lock(info->mutex);
+        if (next == -1 || mpz_cmp(hi, max) >= 0) {
+            break;
+        }
+
+        mpz_add_ui(lo, hi, 1);
+        active = next;
+    }
+
+    mpq_clear(value);
+    mpq_clear(lowest);
+    mpq_clear(crossing);
+    mpq_clear(next_crossing);
+    mpz_clear(lo);
+    mpz_clear(hi);
+    mpz_clear(n);
+    mpz_clear(m);
+    mpz_clear(a);
+    mpz_clear(b);
+    mpz_clear(piece);
+}
+
+// narrows [lo, hi] to the integers u with a u <= b
+static void narrow_range(mpz_ptr lo, mpz_ptr hi, mpq_srcptr a, mpq_srcptr b, mpq_ptr temp) {
+    if (mpq_sgn(a) == 0) {
+        if (mpq_sgn(b) < 0) {
+            mpz_set_ui(lo, 1);
+            mpz_set_ui(hi, 0);
+        }
+
+        return;
+    }
+
+    mpq_div(temp, b, a);
+
+    if (mpq_sgn(a) > 0) {
+        mpz_fdiv_q(mpq_numref(temp), mpq_numref(temp), mpq_denref(temp));
+
+        if (mpz_cmp(mpq_numref(temp), hi) < 0) {
+            mpz_set(hi, mpq_numref(temp));
+        }
+    } else {
+        mpz_cdiv_q(mpq_numref(temp), mpq_numref(temp), mpq_denref(temp));
+
+        if (mpz_cmp(mpq_numref(temp), lo) > 0) {
+            mpz_set(lo, mpq_numref(temp));
+        }
+    }
+}
+
+// counts the points below a node at depth dimensions - 2 without visiting
+// them. with u and v the last two coefficients, x = basis^T (fixed - offset)
+// + u b + v b' for the last two basis vectors b and b', so every row of the
+// relaxation is a half-plane p u + q v <= s. the rows with q > 0 bound v from
+// above and those with q < 0 from below, and for each u at which the bounds
+// do not cross the node holds floor(upper) - ceil(lower) + 1 points. both
+// bounds are envelopes of lines, so their sums are floor_sum_envelope()s.
+// [min, max] from the range LPs predates this node's cuts, so the u at which
+// the bounds cross are cut off first, one pair of lines at a time.
+static void search_count_plane(search_info_t* info, mpz_srcptr min, mpz_srcptr max) {
+    if (mpz_cmp(min, max) > 0) {
+        return;
+    }
+
+    long dimensions = info->dimensions;
+    long u = dimensions - 2;
+    long v = dimensions - 1;
+    long rows = 2 * dimensions + info->inequalities;
+    long start = trace_begin();
+
+    matrix_t* origin = matrix_alloc(dimensions, 1);
+    matrix_t* above = matrix_alloc(rows, 2);   // v <= slope u + intercept
+    matrix_t* below = matrix_alloc(rows, 2);   // -v <= slope u + intercept
+    long above_count = 0;
+    long below_count = 0;
+
+    mpz_t lo;
+    mpz_t hi;
+
+    mpz_init_set(lo, min);
+    mpz_init_set(hi, max);
+
+    mpq_t p;
+    mpq_t q;
+    mpq_t s;
+    mpq_t t0;
+
+    mpq_init(p);
+    mpq_init(q);
+    mpq_init(s);
+    mpq_init(t0);
+
+    for (long row = 0; row < dimensions; ++row) {
+        if (row < u) {
+            mpq_sub(t0, matrix_cat(info->fixed, row, 0), matrix_cat(info->offset, row, 0));
+        } else {
+            mpq_neg(t0, matrix_cat(info->offset, row, 0));
+        }
+
+        for (long col = 0; col < dimensions; ++col) {
+            mpq_ptr x = matrix_at(origin, col, 0);
+
+            mpq_mul(s, t0, matrix_cat(info->basis, row, col));
+            mpq_add(x, x, s);
+        }
+    }
+
+    // x <= widths and -x <= 0, then the inequality rows a x <= b
+    for (long row = 0; row < rows; ++row) {
+        if (row < 2 * dimensions) {
+            long col = row / 2;
+            mpq_srcptr x = matrix_cat(origin, col, 0);
 
-            if (*info->thread_count < info->thread_max) {
-                *info->thread_count += 1;
-                pthread_mutex_unlock(info->mutex);
+            mpq_set(p, matrix_cat(info->basis, u, col));
+            mpq_set(q, matrix_cat(info->basis, v, col));
 
-                pthread_t thread;
-                pthread_create(&thread, NULL, search_thread, search_info_dup(info));
-                pthread_detach(thread);
+            if (row % 2 == 0) {
+                mpq_sub(s, matrix_cat(info->widths, col, 0), x);
             } else {
-                pthread_mutex_unlock(info->mutex);
-                search(info);
+                mpq_neg(p, p);
+                mpq_neg(q, q);
+                mpq_set(s, x);
             }
+        } else {
+            long table_row = 1 + row - 2 * dimensions;
+
+            mpq_set_ui(p, 0, 1);
+            mpq_set_ui(q, 0, 1);
+            mpq_set(s, matrix_cat(info->table, table_row, dimensions));
+
+            for (long col = 0; col < dimensions; ++col) {
+                mpq_srcptr a = matrix_cat(info->table, table_row, col);
+
+                mpq_mul(t0, a, matrix_cat(info->basis, u, col));
+                mpq_add(p, p, t0);
+                mpq_mul(t0, a, matrix_cat(info->basis, v, col));
+                mpq_add(q, q, t0);
+                mpq_mul(t0, a, matrix_cat(origin, col, 0));
+                mpq_sub(s, s, t0);
+            }
+        }
 
-            info->depth -= 1;
+        if (mpq_sgn(q) == 0) {
+            narrow_range(lo, hi, p, s, t0);
+            continue;
         }
 
-        mpq_clear(t0);
-        mpq_clear(t1);
-        mpq_clear(t2);
-        mpz_clear(min);
-        mpz_clear(max);
+        matrix_t* lines = mpq_sgn(q) > 0 ? above : below;
+        long* line_count = mpq_sgn(q) > 0 ? &above_count : &below_count;
+
+        // v <= (s - p u) / q, or -v <= (p u - s) / q for q < 0
+        mpq_div(t0, p, q);
+        mpq_div(s, s, q);
+
+        if (mpq_sgn(q) > 0) {
+            mpq_neg(t0, t0);
+        } else {
+            mpq_neg(s, s);
+        }
+
+        mpq_set(matrix_at(lines, *line_count, 0), t0);
+        mpq_set(matrix_at(lines, *line_count, 1), s);
+        *line_count += 1;
+    }
+
+    // v <= a u + b and -v <= c u + d cross unless -(a + c) u <= b + d
+    for (long i = 0; i < above_count; ++i) {
+        for (long j = 0; j < below_count; ++j) {
+            mpq_add(p, matrix_cat(above, i, 0), matrix_cat(below, j, 0));
+            mpq_neg(p, p);
+            mpq_add(s, matrix_cat(above, i, 1), matrix_cat(below, j, 1));
+            narrow_range(lo, hi, p, s, t0);
+        }
+    }
+
+    mpz_t total;
+    mpz_t part;
+
+    mpz_init_set_ui(total, 0);
+    mpz_init(part);
+
+    if (mpz_cmp(lo, hi) <= 0) {
+        floor_sum_envelope(total, above, above_count, lo, hi);
+        floor_sum_envelope(part, below, below_count, lo, hi);
+        mpz_add(total, total, part);
+
+        mpz_sub(part, hi, lo);
+        mpz_add_ui(part, part, 1);
+        mpz_add(total, total, part);
+    }
+
+    bool mirrored = info->symmetric && !search_zero_prefix(info);
+
+    if (mirrored) {
+        mpz_mul_2exp(part, total, 1);
+    } else {
+        mpz_set(part, total);
+    }
+
+    if (!mpz_fits_slong_p(part)) {
+        count_overflow();
     }
+
+    long count = mpz_get_si(total);
+
+    count_add(&info->count, mpz_get_si(part));
+    info->stats.nodes += count;
+
+    mpz_clear(lo);
+    mpz_clear(hi);
+    mpz_clear(total);
+    mpz_clear(part);
+
+    mpq_clear(p);
+    mpq_clear(q);
+    mpq_clear(s);
+    mpq_clear(t0);
+
+    matrix_free(origin);
+    matrix_free(above);
+    matrix_free(below);
+
+    trace_end("count", start, info->depth, info->fixed);
 }
 
-void* search_thread(void* data) {
-    search_info_t* info = data;
-    search(info);
+// hands the point to every box containing it. the boxes share constraints,
+// which the search has already enforced, so only their bounds are checked.
+static void search_distribute(search_info_t* info) {
+    long dimensions = info->dimensions;
+    long start = trace_begin();
+
+    mpq_t t0;
+    mpq_init(t0);
+
+    for (long col = 0; col < dimensions; ++col) {
+        mpq_ptr y = matrix_at(info->point, col, 0);
+        mpq_set_ui(y, 0, 1);
+
+        for (long row = 0; row < dimensions; ++row) {
+            mpq_mul(t0, matrix_cat(info->fixed, row, 0), matrix_cat(info->basis, row, col));
+            mpq_add(y, y, t0);
+        }
+    }
+
+    mpq_clear(t0);
+
+    for (long i = 0; i < info->box_count; ++i) {
+        lattice_box_t* box = &info->boxes[i];
+        bool inside = true;
+
+        for (long col = 0; inside && col < dimensions; ++col) {
+            mpq_srcptr y = matrix_cat(info->point, col, 0);
+            inside = mpq_cmp(y, matrix_cat(box->lower, 0, col)) >= 0 && mpq_cmp(y, matrix_cat(box->upper, 0, col)) <= 0;
+        }
+
+        if (!inside) {
+            continue;
+        }
+
+        info->box_counts[i] += 1;
+
+        if (box->output) {
+            output_point(box->output, info->fixed);
+        }
+
+        if (box->results_out) {
+            matrix_t* result = matrix_dup(info->fixed);
+
+            pthread_mutex_lock(info->mutex);
+
+            *box->results_out = realloc(*box->results_out, (info->box_results[i] + 1) * sizeof(matrix_t*));
+            (*box->results_out)[info->box_results[i]] = result;
+            info->box_results[i] += 1;
+
+            pthread_mutex_unlock(info->mutex);
+        }
+    }
+
+    trace_end("emit", start, info->depth, info->fixed);
+}
+
+// objective value of the point with coefficients fixed, replacing the shared
+// incumbent if it is strictly better
+static void search_improve(search_info_t* info) {
+    mpq_t value;
+    mpq_t t0;
+
+    mpq_init(value);
+    mpq_init(t0);
+
+    for (long i = 0; i < info->dimensions; ++i) {
+        mpq_mul(t0, matrix_cat(info->fixed, i, 0), matrix_cat(info->objective_c, i, 0));
+        mpq_add(value, value, t0);
+    }
 
     pthread_mutex_lock(info->mutex);
-    *info->thread_count -= 1;
-    pthread_cond_broadcast(info->finished);
+
+    if (!info->incumbent->found || mpq_cmp(value, info->incumbent->value) < 0) {
+        info->incumbent->found = true;
+        mpq_swap(info->incumbent->value, value);
+        matrix_set(info->incumbent->point, info->fixed);
+    }
+
     pthread_mutex_unlock(info->mutex);
 
-    search_info_free(info);
+    mpq_clear(value);
+    mpq_clear(t0);
+}
 
-    return NULL;
+// minimizes the objective over the node's relaxation. returns false if that
+// bound cannot beat the incumbent, otherwise sets start to the coefficient at
+// depth of the relaxed optimum, where the children are most promising.
+static bool search_bound(search_info_t* info, mpq_ptr start) {
+    mpq_t bound;
+    mpq_t t0;
+
+    mpq_init(bound);
+    mpq_init(t0);
+
+    for (long col = 0; col < info->dimensions; ++col) {
+        mpq_neg(matrix_at(info->table, 0, col), matrix_cat(info->objective, col, 0));
+    }
+
+    long begun = trace_begin();
+    bool feasible = lp_solve(info->x, info->table, info->widths, info->dimensions, info->inequalities, info->depth);
+    info->stats.lps += 1;
+    trace_end("lp_solve", begun, info->depth, info->fixed);
+
+    if (!feasible) {
+        mpq_clear(bound);
+        mpq_clear(t0);
+
+        return false;
+    }
+
+    mpq_set(bound, info->objective_offset);
+    mpq_set(start, matrix_cat(info->offset, info->depth, 0));
+
+    for (long col = 0; col < info->dimensions; ++col) {
+        mpq_mul(t0, matrix_cat(info->objective, col, 0), matrix_cat(info->x, col, 0));
+        mpq_add(bound, bound, t0);
+
+        mpq_mul(t0, matrix_cat(info->transform, info->depth, col), matrix_cat(info->x, col, 0));
+        mpq_add(start, start, t0);
+    }
+
+    pthread_mutex_lock(info->mutex);
+    bool promising = !info->incumbent->found || mpq_cmp(bound, info->incumbent->value) < 0;
+    pthread_mutex_unlock(info->mutex);
+
+    mpq_clear(bound);
+    mpq_clear(t0);
+
+    return promising;
 }
 
-static void search_parallel(search_info_t *root) {
-    *root->thread_count = 1;
+// fixes the coefficient at depth to value and searches the child
+static void search_child(search_info_t* info, mpz_srcptr value, mpq_ptr temp) {
+    long row = 1 + info->inequalities + info->depth;
 
-    pthread_t thread;
-    pthread_create(&thread, NULL, search_thread, search_info_dup(root));
-    pthread_detach(thread);
-    pthread_mutex_lock(root->mutex);
+    // rhs of new row = offset - value
+    mpq_set_z(temp, value);
+    mpq_sub(temp, matrix_cat(info->offset, info->depth, 0), temp);
 
-    while (*root->thread_count > 0) {
-        pthread_cond_wait(root->finished, root->mutex);
+    if (mpq_sgn(temp) >= 0) {
+        for (long col = 0; col < info->dimensions; ++col) {
+            mpq_neg(matrix_at(info->table, row, col), matrix_cat(info->transform, info->depth, col));
+        }
+
+        mpq_set(matrix_at(info->table, row, info->dimensions), temp);
+    } else {
+        for (long col = 0; col < info->dimensions; ++col) {
+            mpq_set(matrix_at(info->table, row, col), matrix_cat(info->transform, info->depth, col));
+        }
+
+        mpq_neg(matrix_at(info->table, row, info->dimensions), temp);
     }
 
-    pthread_mutex_unlock(root->mutex);
+    mpq_set_z(matrix_at(info->fixed, info->depth, 0), value);
+    info->depth += 1;
+
+    if (!search_spawn(info)) {
+        search(info);
+    }
+
+    info->depth -= 1;
 }
 
-void enumerate(const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, long* count_out, matrix_t*** results_out, long thread_max) {
-    assert(matrix_rows(basis) == matrix_cols(basis));
+// makes room for added inequality rows, kept by the node's subtree, by moving
+// the fixed rows down past them. returns the first new row.
+static long search_open_rows(search_info_t* info, long added) {
+    long first = 1 + info->inequalities;
 
-    long dimensions = matrix_rows(basis);
+    for (long row = info->depth - 1; added > 0 && row >= 0; --row) {
+        for (long col = 0; col <= info->dimensions; ++col) {
+            mpq_swap(matrix_at(info->table, first + row, col), matrix_at(info->table, first + added + row, col));
+        }
+    }
 
-    search_info_t* root = malloc(sizeof(search_info_t));
+    info->inequalities += added;
 
-    matrix_t* transform = matrix_alloc(dimensions, dimensions);
-    matrix_t* offset = matrix_alloc(dimensions, 1);
+    return first;
+}
 
-    for (long i = 0; i < dimensions; ++i) {
-        mpq_set_ui(matrix_at(transform, i, i), 1, 1);
-        mpq_set(matrix_at(offset, i, 0), matrix_cat(lower, 0, i));
+static void search_close_rows(search_info_t* info, long added) {
+    info->inequalities -= added;
+
+    long first = 1 + info->inequalities;
+
+    for (long row = 0; added > 0 && row < info->depth; ++row) {
+        for (long col = 0; col <= info->dimensions; ++col) {
+            mpq_swap(matrix_at(info->table, first + row, col), matrix_at(info->table, first + added + row, col));
+        }
+    }
+}
+
+// integer range of the coefficient at depth over the node's relaxation, empty
+// (min > max) if the relaxation is infeasible. above cut_depth, each later
+// coefficient that is fractional at either optimum yields a gomory cut, and
+// the cuts become rows for the subtree. returns how many for
+// search_close_rows().
+static long search_range(search_info_t* info, mpz_ptr min, mpz_ptr max) {
+    long dimensions = info->dimensions;
+    long later = dimensions - info->depth - 1;
+    bool cutting = info->depth < info->cut_depth && later > 0;
+
+    matrix_t* forms = cutting ? matrix_view(info->forms, info->depth + 1, 0, later, dimensions + 1) : NULL;
+    matrix_t* cuts = cutting ? matrix_alloc(2 * later, dimensions + 1) : NULL;
+    matrix_t* cuts_view = NULL;
+    long cut_count = 0;
+    long found = 0;
+
+    // lower bound
+    for (long col = 0; col < info->dimensions; ++col) {
+        mpq_neg(matrix_at(info->table, 0, col), matrix_cat(info->transform, info->depth, col));
     }
 
-    matrix_t* lu = matrix_dup(basis);
-    long pivots[dimensions];
+    long start = trace_begin();
+    bool feasible = lp_solve_cuts(info->x, info->table, info->widths, dimensions, info->inequalities, info->depth, forms, cuts, &found);
+    info->stats.lps += 1;
+    trace_end("lp_solve", start, info->depth, info->fixed);
+    cut_count += found;
 
-    matrix_lu(lu, pivots);
-    solve_utltp(transform, lu, pivots);
-    solve_utltp(offset, lu, pivots);
+    if (!feasible) {
+        mpz_set_ui(min, 1);
+        mpz_set_ui(max, 0);
 
-    matrix_free(lu);
+        if (cutting) {
+            matrix_free(forms);
+            matrix_free(cuts);
+        }
 
-    root->dimensions = dimensions;
-    root->depth = 0;
+        return 0;
+    }
 
-    root->transform = transform;
-    root->offset = offset;
-    root->fixed = matrix_alloc(dimensions, 1);
+    mpq_t t0;
+    mpq_t t1;
 
-    root->table = matrix_alloc(2 * dimensions + 1, dimensions + 1);
-    root->x = matrix_alloc(dimensions, 1);
+    mpq_init(t0);
+    mpq_init(t1);
 
-    root->count_out = count_out;
-    root->results_out = results_out;
+    mpq_set(t0, matrix_cat(info->offset, info->depth, 0));
 
-    root->mutex = malloc(sizeof(pthread_mutex_t));
-    root->finished = malloc(sizeof(pthread_cond_t));
-    root->thread_count = malloc(sizeof(long));
-    root->thread_max = thread_max;
+    for (long col = 0; col < info->dimensions; ++col) {
+        mpq_mul(t1, matrix_cat(info->transform, info->depth, col), matrix_cat(info->x, col, 0));
+        mpq_add(t0, t0, t1);
+    }
 
-    pthread_mutex_init(root->mutex, NULL);
-    pthread_cond_init(root->finished, NULL);
+    mpz_cdiv_q(min, mpq_numref(t0), mpq_denref(t0));
 
-    for (long i = 0; i < dimensions; ++i) {
-        mpq_set_ui(matrix_at(root->table, i + 1, i), 1, 1);
-        mpq_sub(matrix_at(root->table, i + 1, dimensions), matrix_cat(upper, 0, i), matrix_cat(lower, 0, i));
+    // upper bound
+    for (long col = 0; col < info->dimensions; ++col) {
+        mpq_set(matrix_at(info->table, 0, col), matrix_cat(info->transform, info->depth, col));
     }
 
-    search_parallel(root);
+    if (cutting) {
+        cuts_view = matrix_view(cuts, cut_count, 0, later, dimensions + 1);
+    }
 
-    matrix_free(transform);
-    matrix_free(offset);
+    start = trace_begin();
+    lp_solve_cuts(info->x, info->table, info->widths, dimensions, info->inequalities, info->depth, forms, cuts_view, &found);
+    info->stats.lps += 1;
+    trace_end("lp_solve", start, info->depth, info->fixed);
+    cut_count += found;
+
+    mpq_set(t0, matrix_cat(info->offset, info->depth, 0));
 
-    pthread_mutex_destroy(root->mutex);
-    pthread_cond_destroy(root->finished);
+    for (long col = 0; col < info->dimensions; ++col) {
+        mpq_mul(t1, matrix_cat(info->transform, info->depth, col), matrix_cat(info->x, col, 0));
+        mpq_add(t0, t0, t1);
+    }
 
-    free(root->mutex);
-    free(root->finished);
-    free((void*) root->thread_count);
+    mpz_fdiv_q(max, mpq_numref(t0), mpq_denref(t0));
 
-    search_info_free(root);
+    mpq_clear(t0);
+    mpq_clear(t1);
+
+    if (!cutting) {
+        return 0;
+    }
+
+    long first = search_open_rows(info, cut_count);
+
+    for (long row = 0; row < cut_count; ++row) {
+        for (long col = 0; col <= dimensions; ++col) {
+            mpq_set(matrix_at(info->table, first + row, col), matrix_cat(cuts, row, col));
+        }
+    }
+
+    matrix_free(forms);
+    matrix_free(cuts);
+    matrix_free(cuts_view);
+
+    return cut_count;
+}
+
+// children in [min, max] starting from the integer nearest start, then
+// alternately outwards on either side
+static void search_outward(search_info_t* info, mpz_srcptr min, mpz_srcptr max, mpq_ptr start) {
+    if (mpz_cmp(min, max) > 0) {
+        return;
+    }
+
+    mpz_t above;
+    mpz_t below;
+
+    mpz_init(above);
+    mpz_init(below);
+
+    mpz_mul_2exp(above, mpq_numref(start), 1);
+    mpz_add(above, above, mpq_denref(start));
+    mpz_fdiv_q(above, above, mpq_denref(start));
+    mpz_fdiv_q_2exp(above, above, 1);
+
+    if (mpz_cmp(above, min) < 0) mpz_set(above, min);
+    if (mpz_cmp(above, max) > 0) mpz_set(above, max);
+
+    mpz_sub_ui(below, above, 1);
+
+    while (mpz_cmp(above, max) <= 0 || mpz_cmp(below, min) >= 0) {
+        if (mpz_cmp(above, max) <= 0) {
+            search_child(info, above, start);
+            mpz_add_ui(above, above, 1);
+        }
+
+        if (mpz_cmp(below, min) >= 0) {
+            search_child(info, below, start);
+            mpz_sub_ui(below, below, 1);
+        }
+    }
+
+    mpz_clear(above);
+    mpz_clear(below);
+}
+
+typedef struct {
+    const search_info_t* info;
+    pthread_mutex_t mutex;
+    long next;                 // next LP to claim, the min and then the max of each coefficient
+    long count;                // LPs to solve
+    mpz_t* bounds;             // mpz_t[count], rounded optimum of each LP
+    bool* strict;              // bool[count], set if rounding cut the LP optimum off
+    bool feasible;
+    long lps;
+} presolve_t;
+
+// a helper on a pool slot of its own, pinned like a worker would be
+typedef struct {
+    presolve_t* presolve;
+    long slot;
+} presolve_helper_t;
+
+static void* presolve_thread(void* data) {
+    presolve_t* presolve = data;
+    const search_info_t* info = presolve->info;
+    long dimensions = info->dimensions;
+
+    matrix_t* table = matrix_dup(info->table);
+    matrix_t* x = matrix_alloc(dimensions, 1);
+    long lps = 0;
+
+    mpq_t t0;
+    mpq_t t1;
+
+    mpq_init(t0);
+    mpq_init(t1);
+
+    for (;;) {
+        pthread_mutex_lock(&presolve->mutex);
+        long job = presolve->next++;
+        bool done = job >= presolve->count || !presolve->feasible;
+        pthread_mutex_unlock(&presolve->mutex);
+
+        if (done) {
+            break;
+        }
+
+        long row = info->depth + 1 + job / 2;
+        bool maximize = job % 2 == 1;
+
+        for (long col = 0; col < dimensions; ++col) {
+            if (maximize) {
+                mpq_set(matrix_at(table, 0, col), matrix_cat(info->transform, row, col));
+            } else {
+                mpq_neg(matrix_at(table, 0, col), matrix_cat(info->transform, row, col));
+            }
+        }
+
+        long start = trace_begin();
+        bool feasible = lp_solve(x, table, info->widths, dimensions, info->inequalities, info->depth);
+        lps += 1;
+        trace_end("lp_solve", start, info->depth, info->fixed);
+
+        if (!feasible) {
+            pthread_mutex_lock(&presolve->mutex);
+            presolve->feasible = false;
+            pthread_mutex_unlock(&presolve->mutex);
+
+            break;
+        }
+
+        mpq_set(t0, matrix_cat(info->offset, row, 0));
+
+        for (long col = 0; col < dimensions; ++col) {
+            mpq_mul(t1, matrix_cat(info->transform, row, col), matrix_cat(x, col, 0));
+            mpq_add(t0, t0, t1);
+        }
+
+        if (maximize) {
+            mpz_fdiv_q(presolve->bounds[job], mpq_numref(t0), mpq_denref(t0));
+        } else {
+            mpz_cdiv_q(presolve->bounds[job], mpq_numref(t0), mpq_denref(t0));
+        }
+
+        presolve->strict[job] = mpz_cmp_ui(mpq_denref(t0), 1) != 0;
+    }
+
+    mpq_clear(t0);
+    mpq_clear(t1);
+
+    matrix_free(table);
+    matrix_free(x);
+
+    pthread_mutex_lock(&presolve->mutex);
+    presolve->lps += lps;
+    pthread_mutex_unlock(&presolve->mutex);
+
+    numstats_flush();
+    trace_flush();
+
+    return NULL;
+}
+
+static void* presolve_helper(void* data) {
+    presolve_helper_t* helper = data;
+    const search_info_t* info = helper->presolve->info;
+
+    if (info->cpus) {
+        affinity_pin(info->cpus[helper->slot % info->cpu_count]);
+    }
+
+    return presolve_thread(helper->presolve);
+}
+
+// bounds every coefficient after depth by its min and max over the node's
+// relaxation, on this thread and helpers on whatever pool slots are free, and
+// rounds them inwards. returns
+// false if some coefficient has no integer in its range, which prunes the
+// node. otherwise the bounds that rounding tightened become inequality rows,
+// ahead of the fixed rows, which cut off fractional parts of the relaxation
+// for the whole subtree. *added_out is what search_close_rows() removes.
+static bool search_presolve(search_info_t* info, long* added_out) {
+    long dimensions = info->dimensions;
+    long count = 2 * (dimensions - info->depth - 1);
+
+    *added_out = 0;
+
+    if (count == 0) {
+        return true;
+    }
+
+    presolve_t presolve;
+    mpz_t bounds[count];
+    bool strict[count];
+
+    presolve.info = info;
+    presolve.next = 0;
+    presolve.count = count;
+    presolve.bounds = bounds;
+    presolve.strict = strict;
+    presolve.feasible = true;
+    presolve.lps = 0;
+
+    pthread_mutex_init(&presolve.mutex, NULL);
+
+    for (long i = 0; i < count; ++i) {
+        mpz_init(bounds[i]);
+    }
+
+    // the helpers count against the pool like workers, so that searches
+    // presolving at once, or sharing the pool in a batch, stay within it
+    long helper_max = (info->thread_max < count ? info->thread_max : count) - 1;
+    presolve_helper_t helpers[helper_max > 0 ? helper_max : 1];
+    pthread_t threads[helper_max > 0 ? helper_max : 1];
+    long helper_count = 0;
+
+    pthread_mutex_lock(info->mutex);
+
+    for (long slot = 0; helper_count < helper_max && *info->thread_count < info->thread_max && slot < info->thread_max; ++slot) {
+        if (!info->slots[slot]) {
+            info->slots[slot] = true;
+            *info->thread_count += 1;
+            helpers[helper_count].presolve = &presolve;
+            helpers[helper_count].slot = slot;
+            ++helper_count;
+        }
+    }
+
+    pthread_mutex_unlock(info->mutex);
+
+    bool started[helper_count > 0 ? helper_count : 1];
+
+    for (long i = 0; i < helper_count; ++i) {
+        started[i] = pthread_create(&threads[i], NULL, presolve_helper, &helpers[i]) == 0;
+    }
+
+    presolve_thread(&presolve);
+
+    for (long i = 0; i < helper_count; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    pthread_mutex_lock(info->mutex);
+
+    for (long i = 0; i < helper_count; ++i) {
+        info->slots[helpers[i].slot] = false;
+        *info->thread_count -= 1;
+    }
+
+    if (helper_count > 0) {
+        pthread_cond_broadcast(info->finished);
+    }
+
+    pthread_mutex_unlock(info->mutex);
+
+    pthread_mutex_destroy(&presolve.mutex);
+    info->stats.lps += presolve.lps;
+
+    bool feasible = presolve.feasible;
+
+    for (long i = 0; feasible && i < count; i += 2) {
+        feasible = mpz_cmp(bounds[i], bounds[i + 1]) <= 0;
+    }
+
+    if (feasible) {
+        long added = 0;
+
+        for (long i = 0; i < count; ++i) {
+            added += strict[i];
+        }
+
+        long first = search_open_rows(info, added);
+
+        mpq_t temp;
+        mpq_init(temp);
+
+        // c = transform x + offset, so c <= max is transform x <= max - offset,
+        // and c >= min is -transform x <= offset - min
+        for (long i = 0, row = first; i < count; ++i) {
+            if (!strict[i]) {
+                continue;
+            }
+
+            long coefficient = info->depth + 1 + i / 2;
+            bool maximize = i % 2 == 1;
+            mpq_ptr rhs = matrix_at(info->table, row, dimensions);
+
+            mpq_set_z(temp, bounds[i]);
+
+            for (long col = 0; col < dimensions; ++col) {
+                if (maximize) {
+                    mpq_set(matrix_at(info->table, row, col), matrix_cat(info->transform, coefficient, col));
+                } else {
+                    mpq_neg(matrix_at(info->table, row, col), matrix_cat(info->transform, coefficient, col));
+                }
+            }
+
+            if (maximize) {
+                mpq_sub(rhs, temp, matrix_cat(info->offset, coefficient, 0));
+            } else {
+                mpq_sub(rhs, matrix_cat(info->offset, coefficient, 0), temp);
+            }
+
+            ++row;
+        }
+
+        mpq_clear(temp);
+
+        *added_out = added;
+    }
+
+    for (long i = 0; i < count; ++i) {
+        mpz_clear(bounds[i]);
+    }
+
+    return feasible;
+}
+
+static void search(search_info_t *info) {
+    info->stats.nodes += 1;
+
+    if (info->depth == info->dimensions) {
+        if (info->objective) {
+            search_improve(info);
+        } else if (info->boxes) {
+            search_distribute(info);
+        } else {
+            search_leaf(info);
+        }
+
+        return;
+    }
+
+    long presolved = 0;
+
+    if (info->depth < info->presolve_depth && !search_presolve(info, &presolved)) {
+        return;
+    }
+
+    mpq_t temp;
+    mpz_t min;
+    mpz_t max;
+    mpz_t value;
+
+    mpq_init(temp);
+    mpz_init(min);
+    mpz_init(max);
+    mpz_init(value);
+
+    long cuts = 0;
+
+    if (!info->objective) {
+        cuts = search_range(info, min, max);
+
+        // the children below zero mirror those above it. the last level
+        // reports its whole range at once, and the plane of the last two is
+        // counted whole, so neither needs halving.
+        bool plane = info->counting && info->depth == info->dimensions - 2;
+
+        if (info->symmetric && !plane && info->depth < info->dimensions - 1 && mpz_sgn(min) < 0 && search_zero_prefix(info)) {
+            mpz_set_ui(min, 0);
+        }
+
+        if (plane) {
+            search_count_plane(info, min, max);
+        } else if (info->depth == info->dimensions - 1 && !info->boxes) {
+            search_leaf_range(info, min, max);
+        } else {
+            for (mpz_set(value, min); mpz_cmp(value, max) <= 0; mpz_add_ui(value, value, 1)) {
+                search_child(info, value, temp);
+            }
+        }
+    } else if (search_bound(info, temp)) {
+        cuts = search_range(info, min, max);
+        search_outward(info, min, max, temp);
+    }
+
+    mpq_clear(temp);
+    mpz_clear(min);
+    mpz_clear(max);
+    mpz_clear(value);
+
+    search_close_rows(info, cuts);
+    search_close_rows(info, presolved);
+}
+
+// adds a copy's counts and statistics to its query's, under info->mutex
+static void search_merge(search_info_t* info) {
+    count_add(info->count_out, info->count);
+
+    for (long i = 0; info->boxes && i < info->box_count; ++i) {
+        info->boxes[i].count += info->box_counts[i];
+    }
+
+    if (info->stats_out) {
+        info->stats_out->nodes += info->stats.nodes;
+        info->stats_out->lps += info->stats.lps;
+    }
+}
+
+void* search_thread(void* data) {
+    spawn_t* spawn = data;
+    search_info_t* info = spawn->info;
+    const search_info_t* src = info ? info : spawn->src;
+    long slot = spawn->slot;
+
+    if (src->cpus) {
+        affinity_pin(src->cpus[slot % src->cpu_count]);
+    }
+
+    if (info) {
+        free(spawn);
+    } else {
+        info = search_info_dup(src);
+        sem_post(&spawn->copied);
+    }
+
+    info->slot = slot;
+    trace_set_worker(slot);
+
+    long start = trace_begin();
+    search(info);
+    trace_end("subtree", start, info->depth, info->fixed);
+
+    // the waiting caller may report before this thread's exit merges its counts
+    numstats_flush();
+    trace_flush();
+
+    pthread_mutex_lock(info->mutex);
+    search_merge(info);
+
+    info->slots[info->slot] = false;
+    *info->thread_count -= 1;
+    *info->active -= 1;
+    pthread_cond_broadcast(info->finished);
+    pthread_mutex_unlock(info->mutex);
+
+    search_info_free(info);
+
+    return NULL;
+}
+
+// the root waits for a free slot, since other searches may share the pool,
+// and then for its own workers to finish
+static void search_parallel(search_info_t *root) {
+    volatile long active = 0;
+    root->active = &active;
+
+    pthread_mutex_lock(root->mutex);
+
+    for (;;) {
+        while (*root->thread_count >= root->thread_max) {
+            pthread_cond_wait(root->finished, root->mutex);
+        }
+
+        pthread_mutex_unlock(root->mutex);
+
+        if (search_spawn(root)) {
+            break;
+        }
+
+        pthread_mutex_lock(root->mutex);
+
+        // a slot was free but its thread did not start: search a copy on
+        // this one, as the worker would have
+        if (*root->thread_count < root->thread_max) {
+            pthread_mutex_unlock(root->mutex);
+
+            search_info_t* info = search_info_dup(root);
+            search(info);
+
+            pthread_mutex_lock(root->mutex);
+            search_merge(info);
+            pthread_mutex_unlock(root->mutex);
+
+            search_info_free(info);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(root->mutex);
+
+    while (active > 0) {
+        pthread_cond_wait(root->finished, root->mutex);
+    }
+
+    pthread_mutex_unlock(root->mutex);
+}
+
+void enumerate_options_init(enumerate_options_t* options) {
+    options->thread_max = 1;
+    options->cpus = NULL;
+    options->cpu_count = 0;
+    options->numa_local = false;
+    options->objective = NULL;
+    options->optimum_out = NULL;
+    options->pool = NULL;
+    options->presolve_depth = 0;
+    options->cut_depth = 0;
+    options->cache_dir = NULL;
+}
+
+enumerate_pool_t* enumerate_pool_alloc(const enumerate_options_t* options) {
+    enumerate_pool_t* pool = malloc(sizeof(enumerate_pool_t));
+
+    pool->thread_count = 0;
+    pool->thread_max = options->thread_max < 1 ? 1 : options->thread_max;
+    pool->slots = calloc(pool->thread_max, sizeof(bool));
+    pool->cpus = options->cpus;
+    pool->cpu_count = options->cpu_count;
+    pool->numa_local = options->numa_local;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    return pool;
+}
+
+void enumerate_pool_free(enumerate_pool_t* pool) {
+    assert(pool->thread_count == 0);
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->finished);
+
+    free(pool->slots);
+    free(pool);
+}
+
+static long find_root(long* parent, long node) {
+    while (parent[node] != node) {
+        parent[node] = parent[parent[node]];
+        node = parent[node];
+    }
+
+    return node;
+}
+
+// connected components of the graph joining coefficient k and coordinate j
+// wherever transform[k][j] != 0. a nonsingular matrix has as many coordinates
+// as coefficients in each component, so every component has a sub-basis.
+static void lattice_split(lattice_t* lattice, const enumerate_options_t* options) {
+    long dimensions = lattice->dimensions;
+    long parent[2 * dimensions];
+    long label[2 * dimensions];
+
+    lattice->block_count = 1;
+    lattice->row_block = NULL;
+    lattice->col_block = NULL;
+    lattice->blocks = NULL;
+
+    for (long i = 0; i < 2 * dimensions; ++i) {
+        parent[i] = i;
+        label[i] = -1;
+    }
+
+    for (long row = 0; row < dimensions; ++row) {
+        for (long col = 0; col < dimensions; ++col) {
+            if (mpq_sgn(matrix_cat(lattice->transform, row, col)) != 0) {
+                parent[find_root(parent, row)] = find_root(parent, dimensions + col);
+            }
+        }
+    }
+
+    long block_count = 0;
+
+    for (long i = 0; i < 2 * dimensions; ++i) {
+        long root = find_root(parent, i);
+
+        if (label[root] == -1) {
+            label[root] = block_count++;
+        }
+    }
+
+    if (block_count == 1) {
+        return;
+    }
+
+    lattice->block_count = block_count;
+    lattice->row_block = malloc(dimensions * sizeof(long));
+    lattice->col_block = malloc(dimensions * sizeof(long));
+    lattice->blocks = malloc(block_count * sizeof(lattice_t*));
+
+    for (long i = 0; i < dimensions; ++i) {
+        lattice->row_block[i] = label[find_root(parent, i)];
+        lattice->col_block[i] = label[find_root(parent, dimensions + i)];
+    }
+
+    for (long block = 0; block < block_count; ++block) {
+        long size = 0;
+
+        for (long i = 0; i < dimensions; ++i) {
+            size += lattice->row_block[i] == block;
+        }
+
+        matrix_t* basis = matrix_alloc(size, size);
+        matrix_t* objective = options->objective ? matrix_alloc(1, size) : NULL;
+
+        for (long row = 0, r = 0; row < dimensions; ++row) {
+            if (lattice->row_block[row] != block) {
+                continue;
+            }
+
+            for (long col = 0, c = 0; col < dimensions; ++col) {
+                if (lattice->col_block[col] == block) {
+                    mpq_set(matrix_at(basis, r, c++), matrix_cat(lattice->basis, row, col));
+                }
+            }
+
+            ++r;
+        }
+
+        for (long col = 0, c = 0; objective && col < dimensions; ++col) {
+            if (lattice->col_block[col] == block) {
+                mpq_set(matrix_at(objective, 0, c++), matrix_cat(options->objective, 0, col));
+            }
+        }
+
+        enumerate_options_t block_options = *options;
+
+        block_options.pool = lattice->pool;
+        block_options.objective = objective;
+        block_options.optimum_out = NULL;
+
+        lattice->blocks[block] = lattice_prepare(basis, &block_options);
+
+        matrix_free(basis);
+
+        if (objective) {
+            matrix_free(objective);
+        }
+    }
+}
+
+lattice_t* lattice_prepare(const matrix_t* basis, const enumerate_options_t* options) {
+    assert(matrix_rows(basis) == matrix_cols(basis));
+
+    long dimensions = matrix_rows(basis);
+
+    lattice_t* lattice = malloc(sizeof(lattice_t));
+
+    lattice->dimensions = dimensions;
+    lattice->basis = matrix_dup(basis);
+    lattice->lu = matrix_dup(basis);
+    lattice->pivots = malloc(dimensions * sizeof(long));
+    lattice->transform = matrix_alloc(dimensions, dimensions);
+
+    for (long i = 0; i < dimensions; ++i) {
+        mpq_set_ui(matrix_at(lattice->transform, i, i), 1, 1);
+    }
+
+    lattice->la_threads = options->thread_max < 1 ? 1 : options->thread_max;
+
+    if (!options->cache_dir || !cache_load(options->cache_dir, basis, lattice->lu, lattice->pivots, lattice->transform)) {
+        matrix_lu(lattice->lu, lattice->pivots, lattice->la_threads);
+        solve_utltp(lattice->transform, lattice->lu, lattice->pivots, lattice->la_threads);
+
+        // a cache that cannot be written only costs the next run the factoring
+        if (options->cache_dir) {
+            cache_store(options->cache_dir, basis, lattice->lu, lattice->pivots, lattice->transform);
+        }
+    }
+
+    lattice->objective = NULL;
+    lattice->objective_c = NULL;
+    lattice->optimum_out = options->optimum_out;
+    lattice->presolve_depth = options->presolve_depth;
+    lattice->cut_depth = options->cut_depth;
+
+    // objective . y = objective . x + objective . lower
+    //               = (basis objective) . coefficients
+    if (options->objective) {
+        lattice->objective = matrix_alloc(dimensions, 1);
+        lattice->objective_c = matrix_alloc(dimensions, 1);
+
+        mpq_t temp;
+        mpq_init(temp);
+
+        for (long i = 0; i < dimensions; ++i) {
+            mpq_set(matrix_at(lattice->objective, i, 0), matrix_cat(options->objective, 0, i));
+
+            for (long j = 0; j < dimensions; ++j) {
+                mpq_mul(temp, matrix_cat(basis, i, j), matrix_cat(options->objective, 0, j));
+                mpq_add(matrix_at(lattice->objective_c, i, 0), matrix_at(lattice->objective_c, i, 0), temp);
+            }
+        }
+
+        mpq_clear(temp);
+    }
+
+    lattice->own_pool = !options->pool;
+    lattice->pool = options->pool ? options->pool : enumerate_pool_alloc(options);
+
+    lattice_split(lattice, options);
+
+    return lattice;
+}
+
+void lattice_free(lattice_t* lattice) {
+    matrix_free(lattice->basis);
+    matrix_free(lattice->lu);
+    matrix_free(lattice->transform);
+    free(lattice->pivots);
+
+    if (lattice->objective) {
+        matrix_free(lattice->objective);
+        matrix_free(lattice->objective_c);
+    }
+
+    for (long block = 0; lattice->blocks && block < lattice->block_count; ++block) {
+        lattice_free(lattice->blocks[block]);
+    }
+
+    free(lattice->row_block);
+    free(lattice->col_block);
+    free(lattice->blocks);
+
+    if (lattice->own_pool) {
+        enumerate_pool_free(lattice->pool);
+    }
+
+    free(lattice);
+}
+
+// searches [lower, upper] under constraints. a single box receives every point
+// found; several boxes (all inside [lower, upper], all with these constraints)
+// each receive the points they contain.
+static void lattice_search(lattice_t* lattice, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, lattice_box_t* boxes, long box_count, enumerate_stats_t* stats_out) {
+    long dimensions = lattice->dimensions;
+    long constraint_count = constraints ? matrix_rows(constraints) : 0;
+
+    search_info_t* root = malloc(sizeof(search_info_t));
+
+    matrix_t* offset = matrix_alloc(dimensions, 1);
+
+    for (long i = 0; i < dimensions; ++i) {
+        mpq_set(matrix_at(offset, i, 0), matrix_cat(lower, 0, i));
+    }
+
+    solve_utltp(offset, lattice->lu, lattice->pivots, lattice->la_threads);
+
+    matrix_t* widths = matrix_alloc(dimensions, 1);
+
+    for (long i = 0; i < dimensions; ++i) {
+        mpq_sub(matrix_at(widths, i, 0), matrix_cat(upper, 0, i), matrix_cat(lower, 0, i));
+    }
+
+    root->dimensions = dimensions;
+    root->depth = 0;
+    root->inequalities = constraint_count;
+    root->presolve_depth = lattice->presolve_depth;
+    root->cut_depth = lattice->cut_depth;
+
+    root->transform = lattice->transform;
+    root->offset = offset;
+    root->widths = widths;
+    root->forms = NULL;
+
+    if (lattice->cut_depth > 0) {
+        root->forms = matrix_alloc(dimensions, dimensions + 1);
+
+        for (long row = 0; row < dimensions; ++row) {
+            for (long col = 0; col < dimensions; ++col) {
+                mpq_set(matrix_at(root->forms, row, col), matrix_cat(lattice->transform, row, col));
+            }
+
+            mpq_set(matrix_at(root->forms, row, dimensions), matrix_cat(offset, row, 0));
+        }
+    }
+
+    root->fixed = matrix_alloc(dimensions, 1);
+
+    // room for the rows of every presolve and cut on the way down
+    long presolve_levels = lattice->presolve_depth < dimensions ? lattice->presolve_depth : dimensions;
+    long cut_levels = lattice->cut_depth < dimensions ? lattice->cut_depth : dimensions;
+    long added_rows = 2 * dimensions * (presolve_levels + cut_levels);
+
+    root->table = matrix_alloc(1 + root->inequalities + added_rows + dimensions, dimensions + 1);
+    root->x = matrix_alloc(dimensions, 1);
+
+    long results_count = 0;
+    long box_results[box_count];
+
+    for (long i = 0; i < box_count; ++i) {
+        box_results[i] = 0;
+    }
+
+    root->count = 0;
+    root->count_out = &boxes[0].count;
+    root->stats.nodes = 0;
+    root->stats.lps = 0;
+    root->stats_out = stats_out;
+    root->results_out = boxes[0].results_out;
+    root->results_count = &results_count;
+    root->output = boxes[0].output;
+
+    root->mutex = &lattice->pool->mutex;
+    root->finished = &lattice->pool->finished;
+    root->thread_count = &lattice->pool->thread_count;
+    root->thread_max = lattice->pool->thread_max;
+    root->active = NULL;
+
+    mpq_t objective_offset;
+    incumbent_t incumbent;
+
+    mpq_init(objective_offset);
+    mpq_init(incumbent.value);
+    incumbent.found = false;
+    incumbent.point = matrix_alloc(dimensions, 1);
+
+    if (lattice->objective) {
+        mpq_t temp;
+        mpq_init(temp);
+
+        for (long i = 0; i < dimensions; ++i) {
+            mpq_mul(temp, matrix_cat(lattice->objective, i, 0), matrix_cat(lower, 0, i));
+            mpq_add(objective_offset, objective_offset, temp);
+        }
+
+        mpq_clear(temp);
+    }
+
+    root->objective = lattice->objective;
+    root->objective_c = lattice->objective_c;
+    root->objective_offset = objective_offset;
+    root->incumbent = &incumbent;
+
+    root->basis = lattice->basis;
+    root->boxes = box_count > 1 ? boxes : NULL;
+    root->box_count = box_count;
+    root->box_counts = NULL;
+    root->box_results = box_results;
+    root->point = NULL;
+    root->symmetric = box_count == 1 && constraint_count == 0 && !lattice->objective;
+
+    for (long i = 0; root->symmetric && i < dimensions; ++i) {
+        mpq_t sum;
+        mpq_init(sum);
+        mpq_add(sum, matrix_cat(lower, 0, i), matrix_cat(upper, 0, i));
+        root->symmetric = mpq_sgn(sum) == 0;
+        mpq_clear(sum);
+    }
+
+    root->mirror = root->symmetric ? matrix_alloc(dimensions, 1) : NULL;
+    root->counting = box_count == 1 && !boxes[0].results_out && !boxes[0].output && !lattice->objective && dimensions >= 2;
+
+    root->slot = 0;
+    root->slots = lattice->pool->slots;
+    root->cpus = lattice->pool->cpus;
+    root->cpu_count = lattice->pool->cpu_count;
+    root->numa_local = lattice->pool->numa_local;
+
+    // a y <= b with y = x + lower becomes a x <= b - a lower
+    mpq_t temp;
+    mpq_init(temp);
+
+    for (long i = 0; i < constraint_count; ++i) {
+        long row = 1 + i;
+        mpq_ptr rhs = matrix_at(root->table, row, dimensions);
+
+        mpq_set(rhs, matrix_cat(constraints, i, dimensions));
+
+        for (long col = 0; col < dimensions; ++col) {
+            mpq_set(matrix_at(root->table, row, col), matrix_cat(constraints, i, col));
+            mpq_mul(temp, matrix_cat(constraints, i, col), matrix_cat(lower, 0, col));
+            mpq_sub(rhs, rhs, temp);
+        }
+    }
+
+    mpq_clear(temp);
+
+    search_parallel(root);
+
+    if (incumbent.found) {
+        boxes[0].count += 1;
+
+        if (boxes[0].output) {
+            output_point(boxes[0].output, incumbent.point);
+        }
+
+        if (boxes[0].results_out) {
+            *boxes[0].results_out = realloc(*boxes[0].results_out, (results_count + 1) * sizeof(matrix_t*));
+            (*boxes[0].results_out)[results_count] = matrix_dup(incumbent.point);
+        }
+
+        if (boxes[0].optimum_out) {
+            mpq_set(boxes[0].optimum_out, incumbent.value);
+        }
+    }
+
+    mpq_clear(objective_offset);
+    mpq_clear(incumbent.value);
+    matrix_free(incumbent.point);
+
+    matrix_free(offset);
+    matrix_free(widths);
+
+    if (root->forms) {
+        matrix_free(root->forms);
+    }
+
+    search_info_free(root);
+}
+
+// one block of a split query, searched on its own thread so that the blocks
+// share the pool
+typedef struct {
+    lattice_t* lattice;
+    matrix_t* lower;           // mpq_t[1][size]
+    matrix_t* upper;           // mpq_t[1][size]
+    matrix_t* constraints;     // mpq_t[constraints][size + 1], or NULL
+    matrix_t** results;        // mpq_t[box.count][size][1], if kept
+    mpq_t optimum;
+    lattice_box_t box;
+    enumerate_stats_t* stats_out;
+} block_query_t;
+
+static void* block_thread(void* data) {
+    block_query_t* query = data;
+
+    lattice_search(query->lattice, query->lower, query->upper, query->constraints, &query->box, 1, query->stats_out);
+
+    return NULL;
+}
+
+// true if a constraint row has coordinates in two blocks
+static bool constraints_couple(const lattice_t* lattice, const matrix_t* constraints) {
+    for (long row = 0; constraints && row < matrix_rows(constraints); ++row) {
+        long block = -1;
+
+        for (long col = 0; col < lattice->dimensions; ++col) {
+            if (mpq_sgn(matrix_cat(constraints, row, col)) == 0) {
+                continue;
+            }
+
+            if (block != -1 && block != lattice->col_block[col]) {
+                return true;
+            }
+
+            block = lattice->col_block[col];
+        }
+    }
+
+    return false;
+}
+
+// the points are the product of the blocks' points, so only counts are
+// combined unless the points themselves are wanted. with an objective the
+// optimum is the sum of the blocks' optima.
+static void lattice_enumerate_blocks(lattice_t* lattice, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out) {
+    long dimensions = lattice->dimensions;
+    long block_count = lattice->block_count;
+    bool keep = output || results_out || lattice->objective;
+
+    block_query_t queries[block_count];
+    pthread_t threads[block_count];
+    bool started[block_count];
+
+    for (long block = 0; block < block_count; ++block) {
+        block_query_t* query = &queries[block];
+        long size = lattice->blocks[block]->dimensions;
+        long constraint_count = 0;
+
+        // a row without coordinates belongs to the first block
+        for (long row = 0; constraints && row < matrix_rows(constraints); ++row) {
+            long owner = 0;
+
+            for (long col = 0; col < dimensions; ++col) {
+                if (mpq_sgn(matrix_cat(constraints, row, col)) != 0) {
+                    owner = lattice->col_block[col];
+                }
+            }
+
+            constraint_count += owner == block;
+        }
+
+        query->lattice = lattice->blocks[block];
+        query->lower = matrix_alloc(1, size);
+        query->upper = matrix_alloc(1, size);
+        query->constraints = constraint_count > 0 ? matrix_alloc(constraint_count, size + 1) : NULL;
+        query->results = NULL;
+        query->stats_out = stats_out;
+
+        for (long col = 0, c = 0; col < dimensions; ++col) {
+            if (lattice->col_block[col] == block) {
+                mpq_set(matrix_at(query->lower, 0, c), matrix_cat(lower, 0, col));
+                mpq_set(matrix_at(query->upper, 0, c), matrix_cat(upper, 0, col));
+                ++c;
+            }
+        }
+
+        for (long row = 0, r = 0; query->constraints && row < matrix_rows(constraints); ++row) {
+            long owner = 0;
+
+            for (long col = 0; col < dimensions; ++col) {
+                if (mpq_sgn(matrix_cat(constraints, row, col)) != 0) {
+                    owner = lattice->col_block[col];
+                }
+            }
+
+            if (owner != block) {
+                continue;
+            }
+
+            for (long col = 0, c = 0; col < dimensions; ++col) {
+                if (lattice->col_block[col] == block) {
+                    mpq_set(matrix_at(query->constraints, r, c++), matrix_cat(constraints, row, col));
+                }
+            }
+
+            mpq_set(matrix_at(query->constraints, r, size), matrix_cat(constraints, row, dimensions));
+            ++r;
+        }
+
+        mpq_init(query->optimum);
+
+        query->box.lower = query->lower;
+        query->box.upper = query->upper;
+        query->box.constraints = query->constraints;
+        query->box.count = 0;
+        query->box.results_out = keep ? &query->results : NULL;
+        query->box.output = NULL;
+        query->box.optimum_out = lattice->objective ? query->optimum : NULL;
+
+        // a block whose thread cannot start is searched once the others are
+        started[block] = pthread_create(&threads[block], NULL, block_thread, query) == 0;
+    }
+
+    for (long block = 0; block < block_count; ++block) {
+        if (started[block]) {
+            pthread_join(threads[block], NULL);
+        } else {
+            block_thread(&queries[block]);
+        }
+    }
+
+    long product = 1;
+
+    for (long block = 0; block < block_count; ++block) {
+        if (__builtin_mul_overflow(product, queries[block].box.count, &product)) {
+            count_overflow();
+        }
+    }
+
+    if (!keep || product == 0) {
+        *count_out += product;
+    } else {
+        // odometer over one result per block
+        long index[block_count];
+        matrix_t* point = matrix_alloc(dimensions, 1);
+
+        for (long block = 0; block < block_count; ++block) {
+            index[block] = 0;
+        }
+
+        for (long n = 0; n < product; ++n) {
+            long next[block_count];
+
+            for (long block = 0; block < block_count; ++block) {
+                next[block] = 0;
+            }
+
+            for (long row = 0; row < dimensions; ++row) {
+                long block = lattice->row_block[row];
+                mpq_set(matrix_at(point, row, 0), matrix_cat(queries[block].results[index[block]], next[block]++, 0));
+            }
+
+            if (output) {
+                output_point(output, point);
+            }
+
+            if (results_out) {
+                *results_out = realloc(*results_out, (n + 1) * sizeof(matrix_t*));
+                (*results_out)[n] = matrix_dup(point);
+            }
+
+            for (long block = 0; block < block_count && ++index[block] == queries[block].box.count; ++block) {
+                index[block] = 0;
+            }
+        }
+
+        *count_out += product;
+
+        if (lattice->objective && lattice->optimum_out) {
+            mpq_set_ui(lattice->optimum_out, 0, 1);
+
+            for (long block = 0; block < block_count; ++block) {
+                mpq_add(lattice->optimum_out, lattice->optimum_out, queries[block].optimum);
+            }
+        }
+
+        matrix_free(point);
+    }
+
+    for (long block = 0; block < block_count; ++block) {
+        block_query_t* query = &queries[block];
+
+        for (long i = 0; query->results && i < query->box.count; ++i) {
+            matrix_free(query->results[i]);
+        }
+
+        free(query->results);
+        mpq_clear(query->optimum);
+        matrix_free(query->lower);
+        matrix_free(query->upper);
+
+        if (query->constraints) {
+            matrix_free(query->constraints);
+        }
+    }
+}
+
+void lattice_enumerate(lattice_t* lattice, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out) {
+    if (lattice->block_count > 1 && !constraints_couple(lattice, constraints)) {
+        lattice_enumerate_blocks(lattice, lower, upper, constraints, count_out, results_out, output, stats_out);
+        return;
+    }
+
+    lattice_box_t box;
+
+    box.lower = lower;
+    box.upper = upper;
+    box.constraints = constraints;
+    box.count = 0;
+    box.results_out = results_out;
+    box.output = output;
+    box.optimum_out = lattice->optimum_out;
+
+    lattice_search(lattice, lower, upper, constraints, &box, 1, stats_out);
+
+    *count_out += box.count;
+}
+
+// log of the number of integer points in the real box, which is what
+// decides whether searching a hull beats searching its boxes separately
+static double box_volume(const matrix_t* lower, const matrix_t* upper) {
+    double volume = 0;
+
+    for (long col = 0; col < matrix_cols(lower); ++col) {
+        double width = mpq_get_d(matrix_cat(upper, 0, col)) - mpq_get_d(matrix_cat(lower, 0, col));
+        volume += log(width < 0 ? 1 : width + 1);
+    }
+
+    return volume;
+}
+
+static double volume_sum(double a, double b) {
+    return a > b ? a + log1p(exp(b - a)) : b + log1p(exp(a - b));
+}
+
+// boxes are merged greedily into groups whose hull holds no more points than
+// the group and the box searched separately; each group is then searched once
+// and its points distributed. with an objective every box is searched alone.
+void lattice_enumerate_batch(lattice_t* lattice, lattice_box_t* boxes, long box_count, enumerate_stats_t* stats_out) {
+    long dimensions = lattice->dimensions;
+
+    long* group_of = malloc(box_count * sizeof(long));
+    matrix_t** hull_lower = malloc(box_count * sizeof(matrix_t*));
+    matrix_t** hull_upper = malloc(box_count * sizeof(matrix_t*));
+    double* hull_volume = malloc(box_count * sizeof(double));
+    const matrix_t** hull_constraints = malloc(box_count * sizeof(matrix_t*));
+    long group_count = 0;
+
+    matrix_t* merged_lower = matrix_alloc(1, dimensions);
+    matrix_t* merged_upper = matrix_alloc(1, dimensions);
+
+    for (long i = 0; i < box_count; ++i) {
+        lattice_box_t* box = &boxes[i];
+        double volume = box_volume(box->lower, box->upper);
+
+        box->count = 0;
+        group_of[i] = -1;
+
+        for (long group = 0; !lattice->objective && group < group_count; ++group) {
+            if (hull_constraints[group] != box->constraints) {
+                continue;
+            }
+
+            for (long col = 0; col < dimensions; ++col) {
+                mpq_srcptr l0 = matrix_cat(hull_lower[group], 0, col);
+                mpq_srcptr l1 = matrix_cat(box->lower, 0, col);
+                mpq_srcptr u0 = matrix_cat(hull_upper[group], 0, col);
+                mpq_srcptr u1 = matrix_cat(box->upper, 0, col);
+
+                mpq_set(matrix_at(merged_lower, 0, col), mpq_cmp(l0, l1) < 0 ? l0 : l1);
+                mpq_set(matrix_at(merged_upper, 0, col), mpq_cmp(u0, u1) > 0 ? u0 : u1);
+            }
+
+            double merged_volume = box_volume(merged_lower, merged_upper);
+
+            if (merged_volume <= volume_sum(hull_volume[group], volume)) {
+                matrix_set(hull_lower[group], merged_lower);
+                matrix_set(hull_upper[group], merged_upper);
+                hull_volume[group] = merged_volume;
+                group_of[i] = group;
+
+                break;
+            }
+        }
+
+        if (group_of[i] == -1) {
+            hull_lower[group_count] = matrix_dup(box->lower);
+            hull_upper[group_count] = matrix_dup(box->upper);
+            hull_volume[group_count] = volume;
+            hull_constraints[group_count] = box->constraints;
+            group_of[i] = group_count++;
+        }
+    }
+
+    lattice_box_t* members = malloc(box_count * sizeof(lattice_box_t));
+
+    for (long group = 0; group < group_count; ++group) {
+        long member_count = 0;
+
+        for (long i = 0; i < box_count; ++i) {
+            if (group_of[i] == group) {
+                members[member_count++] = boxes[i];
+            }
+        }
+
+        lattice_search(lattice, hull_lower[group], hull_upper[group], hull_constraints[group], members, member_count, stats_out);
+
+        for (long i = 0, j = 0; i < box_count; ++i) {
+            if (group_of[i] == group) {
+                boxes[i].count = members[j++].count;
+            }
+        }
+
+        matrix_free(hull_lower[group]);
+        matrix_free(hull_upper[group]);
+    }
+
+    matrix_free(merged_lower);
+    matrix_free(merged_upper);
+
+    free(members);
+    free(group_of);
+    free(hull_lower);
+    free(hull_upper);
+    free(hull_volume);
+    free(hull_constraints);
+}
+
+// coordinate col of every lattice point is an integer multiple of the gcd
+// of the column, taken over the rationals
+static void column_step(const lattice_t* lattice, long col, mpq_ptr step) {
+    mpz_t scale;
+    mpz_init_set_ui(scale, 1);
+
+    for (long row = 0; row < lattice->dimensions; ++row) {
+        mpz_lcm(scale, scale, mpq_denref(matrix_cat(lattice->basis, row, col)));
+    }
+
+    mpz_t gcd;
+    mpz_t temp;
+    mpz_init_set_ui(gcd, 0);
+    mpz_init(temp);
+
+    for (long row = 0; row < lattice->dimensions; ++row) {
+        mpq_srcptr x = matrix_cat(lattice->basis, row, col);
+
+        mpz_divexact(temp, scale, mpq_denref(x));
+        mpz_mul(temp, temp, mpq_numref(x));
+        mpz_gcd(gcd, gcd, temp);
+    }
+
+    mpq_set_num(step, gcd);
+    mpq_set_den(step, scale);
+    mpq_canonicalize(step);
+
+    mpz_clear(scale);
+    mpz_clear(gcd);
+    mpz_clear(temp);
+}
+
+// the nearest multiple of step strictly above value if up, below it otherwise
+static void step_past(mpq_ptr dest, mpq_srcptr value, mpq_srcptr step, bool up) {
+    mpq_t q;
+    mpq_init(q);
+    mpq_div(q, value, step);
+
+    if (up) {
+        mpz_fdiv_q(mpq_numref(dest), mpq_numref(q), mpq_denref(q));
+        mpz_add_ui(mpq_numref(dest), mpq_numref(dest), 1);
+    } else {
+        mpz_cdiv_q(mpq_numref(dest), mpq_numref(q), mpq_denref(q));
+        mpz_sub_ui(mpq_numref(dest), mpq_numref(dest), 1);
+    }
+
+    mpz_set_ui(mpq_denref(dest), 1);
+    mpq_mul(dest, dest, step);
+
+    mpq_clear(q);
+}
+
+static void append_results(matrix_t*** results_out, long* count, matrix_t** results, long n) {
+    *results_out = realloc(*results_out, (*count + n) * sizeof(matrix_t*));
+    memcpy(*results_out + *count, results, n * sizeof(matrix_t*));
+    *count += n;
+}
+
+// slab i of new \ old keeps coordinates before i inside both boxes, puts
+// coordinate i below or above the old box, and leaves the rest free, so the
+// slabs are disjoint boxes covering the difference. a lattice coordinate
+// moves in steps of its column gcd, which turns "outside the old box" into
+// closed bounds. each slab costs a root-to-leaf search of its own, so past
+// UPDATE_SLAB_MAX slabs, or slabs holding more than half of the new box, one
+// search of the new box is cheaper.
+#define UPDATE_SLAB_MAX 2
+
+void lattice_enumerate_update(lattice_t* lattice, const matrix_t* old_lower, const matrix_t* old_upper, matrix_t* const* old_results, long old_count, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out) {
+    if (lattice->objective) {
+        lattice_enumerate(lattice, lower, upper, constraints, count_out, results_out, output, stats_out);
+        return;
+    }
+
+    long dimensions = lattice->dimensions;
+    matrix_t* slab_lowers[2 * dimensions];
+    matrix_t* slab_uppers[2 * dimensions];
+    long slab_count = 0;
+    double slab_volume = -INFINITY;
+
+    mpq_t t0;
+    mpq_init(t0);
+    mpq_t step;
+    mpq_init(step);
+
+    for (long col = 0; col < dimensions; ++col) {
+        mpq_srcptr l0 = matrix_cat(old_lower, 0, col);
+        mpq_srcptr u0 = matrix_cat(old_upper, 0, col);
+
+        column_step(lattice, col, step);
+
+        for (long side = 0; side < 2; ++side) {
+            matrix_t* slab_lower = matrix_dup(lower);
+            matrix_t* slab_upper = matrix_dup(upper);
+
+            for (long prev = 0; prev < col; ++prev) {
+                mpq_ptr l = matrix_at(slab_lower, 0, prev);
+                mpq_ptr u = matrix_at(slab_upper, 0, prev);
+
+                if (mpq_cmp(l, matrix_cat(old_lower, 0, prev)) < 0) {
+                    mpq_set(l, matrix_cat(old_lower, 0, prev));
+                }
+
+                if (mpq_cmp(u, matrix_cat(old_upper, 0, prev)) > 0) {
+                    mpq_set(u, matrix_cat(old_upper, 0, prev));
+                }
+            }
+
+            if (side == 0) {
+                step_past(t0, l0, step, false);
+
+                if (mpq_cmp(t0, matrix_cat(slab_upper, 0, col)) < 0) {
+                    mpq_set(matrix_at(slab_upper, 0, col), t0);
+                }
+            } else {
+                step_past(t0, u0, step, true);
+
+                if (mpq_cmp(t0, matrix_cat(slab_lower, 0, col)) > 0) {
+                    mpq_set(matrix_at(slab_lower, 0, col), t0);
+                }
+            }
+
+            bool empty = false;
+
+            for (long c = 0; !empty && c < dimensions; ++c) {
+                empty = mpq_cmp(matrix_cat(slab_lower, 0, c), matrix_cat(slab_upper, 0, c)) > 0;
+            }
+
+            if (empty) {
+                matrix_free(slab_lower);
+                matrix_free(slab_upper);
+                continue;
+            }
+
+            slab_volume = volume_sum(slab_volume, box_volume(slab_lower, slab_upper));
+            slab_lowers[slab_count] = slab_lower;
+            slab_uppers[slab_count] = slab_upper;
+            slab_count += 1;
+        }
+    }
+
+    mpq_clear(step);
+
+    if (slab_count > UPDATE_SLAB_MAX || slab_volume > box_volume(lower, upper) - log(2)) {
+        for (long i = 0; i < slab_count; ++i) {
+            matrix_free(slab_lowers[i]);
+            matrix_free(slab_uppers[i]);
+        }
+
+        mpq_clear(t0);
+        lattice_enumerate(lattice, lower, upper, constraints, count_out, results_out, output, stats_out);
+        return;
+    }
+
+    long count = 0;
+    matrix_t* point = matrix_alloc(1, dimensions);
+
+    for (long i = 0; i < old_count; ++i) {
+        bool inside = true;
+
+        for (long col = 0; inside && col < dimensions; ++col) {
+            mpq_ptr y = matrix_at(point, 0, col);
+            mpq_set_ui(y, 0, 1);
+
+            for (long row = 0; row < dimensions; ++row) {
+                mpq_mul(t0, matrix_cat(old_results[i], row, 0), matrix_cat(lattice->basis, row, col));
+                mpq_add(y, y, t0);
+            }
+
+            inside = mpq_cmp(y, matrix_cat(lower, 0, col)) >= 0 && mpq_cmp(y, matrix_cat(upper, 0, col)) <= 0;
+        }
+
+        if (!inside) {
+            continue;
+        }
+
+        if (output) {
+            output_point(output, old_results[i]);
+        }
+
+        if (results_out) {
+            matrix_t* result = matrix_dup(old_results[i]);
+            append_results(results_out, &count, &result, 1);
+        } else {
+            count += 1;
+        }
+    }
+
+    for (long i = 0; i < slab_count; ++i) {
+        long found = 0;
+        matrix_t** results = NULL;
+
+        lattice_enumerate(lattice, slab_lowers[i], slab_uppers[i], constraints, &found, results_out ? &results : NULL, output, stats_out);
+
+        if (results_out) {
+            append_results(results_out, &count, results, found);
+            free(results);
+        } else {
+            count += found;
+        }
+
+        matrix_free(slab_lowers[i]);
+        matrix_free(slab_uppers[i]);
+    }
+
+    *count_out += count;
+
+    mpq_clear(t0);
+    matrix_free(point);
+}
+
+void enumerate(const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out, const enumerate_options_t* options) {
+    lattice_t* lattice = lattice_prepare(basis, options);
+
+    lattice_enumerate(lattice, lower, upper, constraints, count_out, results_out, output, stats_out);
+    lattice_free(lattice);
 }
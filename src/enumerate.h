@@ -1,6 +1,93 @@
 #pragma once
 #define _POSIX_C_SOURCE 200809L
 
+#include <stdbool.h>
+#include <gmp.h>
+
 #include "la.h"
+#include "output.h"
+
+typedef struct {
+    long nodes; // calls to search(), leaves included
+    long lps;   // calls to lp_solve()
+} enumerate_stats_t;
+
+// a set of worker slots that several lattices, searched concurrently, can
+// share instead of each starting thread_max workers of its own
+typedef struct enumerate_pool_s enumerate_pool_t;
+
+typedef struct {
+    long thread_max;
+    const long* cpus; // worker i is pinned to cpus[i % cpu_count], or NULL to float
+    long cpu_count;
+    bool numa_local;  // workers copy their own search state after pinning (first-touch placement)
+
+    // with an objective (mpq_t[1][dimensions], over the lattice points) only a
+    // point minimizing it is reported, and its value is stored in optimum_out
+    const matrix_t* objective;
+    mpq_ptr optimum_out;
+
+    // workers come from this pool if given, and the fields above except the
+    // objective are then taken from the pool instead
+    enumerate_pool_t* pool;
+
+    // nodes at depths below this first bound every later coefficient by its
+    // own LPs, solved in parallel, and add the rounded bounds as rows for
+    // their subtree. 0 (the default) skips this, 1 does it at the root only.
+    long presolve_depth;
+
+    // nodes at depths below this derive gomory mixed-integer cuts on the later
+    // coefficients from the optimal tables of their range LPs, and add them as
+    // rows for their subtree. 0 (the default) adds none.
+    long cut_depth;
+
+    // lattice_prepare() loads the factored basis from this directory if it
+    // holds an entry for the basis, and stores one otherwise. NULL (the
+    // default) always factors.
+    const char* cache_dir;
+} enumerate_options_t;
+
+// a basis factored once, with its worker bookkeeping, for many queries. calls
+// on one lattice must not overlap.
+typedef struct lattice_s lattice_t;
+
+// one query of a batch. count, and the results and output if given, receive
+// what enumerate() would report for the box alone.
+typedef struct {
+    const matrix_t* lower;       // mpq_t[1][dimensions]
+    const matrix_t* upper;       // mpq_t[1][dimensions]
+    const matrix_t* constraints; // mpq_t[constraints][dimensions + 1], or NULL
+    long count;
+    matrix_t*** results_out;     // or NULL
+    output_t* output;            // or NULL
+    mpq_ptr optimum_out;         // with an objective, or NULL
+} lattice_box_t;
+
+void enumerate_options_init(enumerate_options_t* options);
+
+enumerate_pool_t* enumerate_pool_alloc(const enumerate_options_t* options);
+void enumerate_pool_free(enumerate_pool_t* pool);
+
+lattice_t* lattice_prepare(const matrix_t* basis, const enumerate_options_t* options);
+void lattice_enumerate(lattice_t* lattice, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out);
+
+// overlapping boxes with the same constraints (compared by pointer) may share
+// one search of their hull
+void lattice_enumerate_batch(lattice_t* lattice, lattice_box_t* boxes, long box_count, enumerate_stats_t* stats_out);
+
+// the points in [lower, upper] given old_results, the old_count points an
+// earlier query found in [old_lower, old_upper] with the same constraints.
+// old points still inside are kept and only the difference of the boxes is
+// searched, as up to two slabs per coordinate that changed. each slab is a
+// search of its own, so when more than a couple of slabs are needed, or they
+// hold most of the new box, the new box is searched in full instead, as it
+// is with an objective.
+void lattice_enumerate_update(lattice_t* lattice, const matrix_t* old_lower, const matrix_t* old_upper, matrix_t* const* old_results, long old_count, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out);
+void lattice_free(lattice_t* lattice);
 
-void enumerate(const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, long* count_out, matrix_t*** results_out, long thread_max);
+// lattice points y in [lower, upper] with a y <= b, where constraints
+// is mpq_t[constraints][dimensions + 1] holding a and b per row, or NULL.
+// with neither results_out nor output, and no objective, the points below
+// each node with all but the last two coefficients fixed are counted in
+// closed form instead of being visited.
+void enumerate(const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out, const enumerate_options_t* options);
@@ -0,0 +1,92 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <gmp.h>
+
+#include "generate.h"
+#include "la.h"
+
+// |det| of src, zero if singular
+static void determinant(mpz_ptr dest, const matrix_t* src) {
+    long size = matrix_rows(src);
+    matrix_t* lu = matrix_dup(src);
+    long pivots[size];
+
+    matrix_lu(lu, pivots, 1);
+
+    mpq_t product;
+    mpq_init(product);
+    mpq_set_ui(product, 1, 1);
+
+    for (long i = 0; i < size; ++i) {
+        mpq_mul(product, product, matrix_cat(lu, i, i));
+    }
+
+    mpq_abs(product, product);
+    assert(mpz_cmp_ui(mpq_denref(product), 1) == 0);
+    mpz_set(dest, mpq_numref(product));
+
+    mpq_clear(product);
+    matrix_free(lu);
+}
+
+void generate_instance(gmp_randstate_t state, long dimensions, long bits, long expected, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out) {
+    assert(dimensions >= 1);
+    assert(bits >= 1);
+    assert(expected >= 1);
+
+    matrix_t* basis = matrix_alloc(dimensions, dimensions);
+    matrix_t* lower = matrix_alloc(1, dimensions);
+    matrix_t* upper = matrix_alloc(1, dimensions);
+
+    mpz_t det;
+    mpz_t side;
+    mpz_t shift;
+
+    mpz_init(det);
+    mpz_init(side);
+    mpz_init(shift);
+
+    do {
+        for (long row = 0; row < dimensions; ++row) {
+            for (long col = 0; col < dimensions; ++col) {
+                mpq_ptr x = matrix_at(basis, row, col);
+
+                mpz_urandomb(mpq_numref(x), state, bits);
+                mpz_set_ui(mpq_denref(x), 1);
+
+                if (gmp_urandomb_ui(state, 1)) {
+                    mpz_neg(mpq_numref(x), mpq_numref(x));
+                }
+            }
+        }
+
+        determinant(det, basis);
+    } while (mpz_sgn(det) == 0);
+
+    // side^dimensions ~ expected * |det|
+    mpz_mul_ui(side, det, expected);
+    mpz_root(side, side, dimensions);
+
+    if (mpz_sgn(side) == 0) {
+        mpz_set_ui(side, 1);
+    }
+
+    for (long col = 0; col < dimensions; ++col) {
+        mpz_urandomm(shift, state, side);
+        mpz_fdiv_q_2exp(mpq_numref(matrix_at(lower, 0, col)), side, 1);
+        mpz_neg(mpq_numref(matrix_at(lower, 0, col)), mpq_numref(matrix_at(lower, 0, col)));
+        mpz_add(mpq_numref(matrix_at(lower, 0, col)), mpq_numref(matrix_at(lower, 0, col)), shift);
+        mpz_add(mpq_numref(matrix_at(upper, 0, col)), mpq_numref(matrix_at(lower, 0, col)), side);
+    }
+
+    mpz_clear(det);
+    mpz_clear(side);
+    mpz_clear(shift);
+
+    *basis_out = basis;
+    *lower_out = lower;
+    *upper_out = upper;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <gmp.h>
+
+#include "la.h"
+
+// random nonsingular integer basis with entries of at most bits bits, and a
+// box whose volume is about expected times the lattice determinant, so that
+// it holds about expected lattice points.
+void generate_instance(gmp_randstate_t state, long dimensions, long bits, long expected, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out);
@@ -5,13 +5,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <gmp.h>
+#include <pthread.h>
 
 #include "la.h"
 
-#ifndef NDEBUG
-size_t max_size;
-#endif
-
 struct matrix_s {
     mpq_t* _data;
     long _stride;
@@ -51,6 +48,12 @@ mpq_srcptr matrix_cat(const matrix_t* src, long row, long col) {
     return src->_data[src->_stride * _row + _col];
 }
 
+mpq_t* matrix_data(matrix_t* src, long* stride_out) {
+    *stride_out = src->_stride;
+
+    return src->_data + src->_stride * src->_row + src->_col;
+}
+
 matrix_t* matrix_alloc(long rows, long cols) {
     matrix_t* dest = malloc(sizeof(matrix_t));
     dest->_data = malloc(rows * cols * sizeof(mpq_t));
@@ -175,52 +178,162 @@ void matrix_dot(mpq_ptr dest, const matrix_t* src1, const matrix_t* src2) {
     mpq_clear(temp);
 }
 
-void matrix_lu(matrix_t* src, long* pivots) {
-    assert(src->_rows == src->_cols);
+#define SOLVE_BLOCK 8
+#define SOLVE_PARALLEL_MIN 4096
+#define LU_PARALLEL_MIN 32
+
+// helpers wait here until the caller knows how many of them started, and has
+// sized the barrier and set threads to match
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool open;
+} lu_start_t;
+
+typedef struct {
+    matrix_t* src;
+    long* pivots;
+    long size;
+    long thread;
+    long threads;
+    bool* skip;
+    pthread_barrier_t* barrier;
+    lu_start_t* start;
+} lu_info_t;
+
+// rows (i, size) are interleaved across threads, so each thread only writes
+// its own rows and reads the shared pivot row. thread 0 picks and swaps the
+// pivot row between the two barriers of each step.
+static void* lu_thread(void* data) {
+    lu_info_t* info = data;
+    matrix_t* src = info->src;
+    long size = info->size;
+
+    if (info->thread != 0) {
+        pthread_mutex_lock(&info->start->mutex);
+
+        while (!info->start->open) {
+            pthread_cond_wait(&info->start->cond, &info->start->mutex);
+        }
+
+        pthread_mutex_unlock(&info->start->mutex);
+    }
 
-    long size = src->_rows;
     mpq_t temp;
     mpq_init(temp);
 
-    for (long i = 0; i < size; ++i) {
-        pivots[i] = i;
-    }
+    NUMSTATS_ENTER(NUMSTATS_MATRIX_LU);
 
     for (long i = 0; i < size; ++i) {
-        long pivotRow = -1;
-
-        for (long row = i; row < size; ++row) {
-            if (mpq_sgn(matrix_at(src, row, i)) != 0) {
-                pivotRow = row;
-                break;
+        if (info->thread == 0) {
+            long pivotRow = -1;
+
+            for (long row = i; row < size; ++row) {
+                if (mpq_sgn(matrix_at(src, row, i)) != 0) {
+                    pivotRow = row;
+                    break;
+                }
             }
-        }
 
-        if (pivotRow == -1) {
-            continue;
-        }
+            *info->skip = pivotRow == -1;
 
-        pivots[i] = pivotRow;
+            if (pivotRow != -1) {
+                info->pivots[i] = pivotRow;
 
-        if (pivotRow != i) {
-            for (long col = 0; col < size; ++col) {
-                mpq_swap(matrix_at(src, i, col), matrix_at(src, pivotRow, col));
+                if (pivotRow != i) {
+                    for (long col = 0; col < size; ++col) {
+                        mpq_swap(matrix_at(src, i, col), matrix_at(src, pivotRow, col));
+                    }
+                }
             }
         }
 
-        for (long row = i + 1; row < size; ++row) {
-            mpq_div(matrix_at(src, row, i), matrix_at(src, row, i), matrix_at(src, i, i));
-        }
+        pthread_barrier_wait(info->barrier);
+
+        if (!*info->skip) {
+            long first = i + 1 + (info->thread - (i + 1) % info->threads + info->threads) % info->threads;
 
-        for (long row = i + 1; row < size; ++row) {
-            for (long col = i + 1; col < size; ++col) {
-                mpq_mul(temp, matrix_at(src, row, i), matrix_at(src, i, col));
-                mpq_sub(matrix_at(src, row, col), matrix_at(src, row, col), temp);
+            for (long row = first; row < size; row += info->threads) {
+                mpq_div(matrix_at(src, row, i), matrix_at(src, row, i), matrix_at(src, i, i));
+
+                for (long col = i + 1; col < size; ++col) {
+                    mpq_mul(temp, matrix_at(src, row, i), matrix_at(src, i, col));
+                    mpq_sub(matrix_at(src, row, col), matrix_at(src, row, col), temp);
+                }
             }
         }
+
+        pthread_barrier_wait(info->barrier);
     }
 
+    NUMSTATS_LEAVE();
     mpq_clear(temp);
+
+    return NULL;
+}
+
+void matrix_lu(matrix_t* src, long* pivots, long thread_max) {
+    assert(src->_rows == src->_cols);
+
+    long size = src->_rows;
+    long threads = size < LU_PARALLEL_MIN || thread_max < 1 ? 1 : thread_max;
+
+    if (threads > size / 8) {
+        threads = size / 8 < 1 ? 1 : size / 8;
+    }
+
+    for (long i = 0; i < size; ++i) {
+        pivots[i] = i;
+    }
+
+    bool skip = false;
+    pthread_barrier_t barrier;
+    lu_start_t start = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false };
+
+    lu_info_t infos[threads];
+    pthread_t handles[threads];
+    long started = 1;
+
+    // a helper that fails to start leaves its index to the next one, so the
+    // started threads always number 0 to started - 1
+    for (long thread = 0; thread < threads; ++thread) {
+        long index = thread == 0 ? 0 : started;
+        lu_info_t* info = &infos[index];
+
+        info->src = src;
+        info->pivots = pivots;
+        info->size = size;
+        info->thread = index;
+        info->skip = &skip;
+        info->barrier = &barrier;
+        info->start = &start;
+
+        if (thread != 0 && pthread_create(&handles[started], NULL, lu_thread, info) == 0) {
+            ++started;
+        }
+    }
+
+    pthread_barrier_init(&barrier, NULL, started);
+
+    pthread_mutex_lock(&start.mutex);
+
+    for (long thread = 0; thread < started; ++thread) {
+        infos[thread].threads = started;
+    }
+
+    start.open = true;
+    pthread_cond_broadcast(&start.cond);
+    pthread_mutex_unlock(&start.mutex);
+
+    lu_thread(&infos[0]);
+
+    for (long thread = 1; thread < started; ++thread) {
+        pthread_join(handles[thread], NULL);
+    }
+
+    pthread_barrier_destroy(&barrier);
+    pthread_mutex_destroy(&start.mutex);
+    pthread_cond_destroy(&start.cond);
 }
 
 void solve_p(matrix_t* dest, const long* pivots) {
@@ -243,109 +356,198 @@ void solve_pt(matrix_t* dest, const long* pivots) {
     }
 }
 
-void solve_l(matrix_t* dest, const matrix_t* src) {
-    assert(src->_rows == src->_cols);
-    assert(dest->_rows == src->_rows);
+// each kernel sweeps the factor row by row once per block of SOLVE_BLOCK
+// right hand side columns, applying every factor entry to the whole block.
+typedef void (*solve_block_t)(matrix_t* dest, const matrix_t* src, long dcol0, long dcol1, mpq_ptr temp);
 
+static void solve_block_l(matrix_t* dest, const matrix_t* src, long dcol0, long dcol1, mpq_ptr temp) {
     long size = src->_rows;
 
-    mpq_t temp;
-    mpq_init(temp);
+    for (long row = 0; row < size; ++row) {
+        for (long col = 0; col < row; ++col) {
+            mpq_srcptr x = matrix_cat(src, row, col);
 
-    for (long dcol = 0; dcol < dest->_cols; ++dcol) {
-        for (long row = 0; row < size; ++row) {
-            for (long col = 0; col < row; ++col) {
-                mpq_mul(temp, matrix_cat(src, row, col), matrix_at(dest, col, dcol));
+            if (mpq_sgn(x) == 0) {
+                continue;
+            }
+
+            for (long dcol = dcol0; dcol < dcol1; ++dcol) {
+                mpq_mul(temp, x, matrix_at(dest, col, dcol));
                 mpq_sub(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), temp);
             }
         }
     }
-
-    mpq_clear(temp);
 }
 
-void solve_lt(matrix_t* dest, const matrix_t* src) {
-    assert(src->_rows == src->_cols);
-    assert(dest->_rows == src->_rows);
+static void solve_block_lt(matrix_t* dest, const matrix_t* src, long dcol0, long dcol1, mpq_ptr temp) {
+    long size = src->_rows;
+
+    for (long row = size - 1; row >= 0; --row) {
+        for (long col = 0; col < row; ++col) {
+            mpq_srcptr x = matrix_cat(src, row, col);
+
+            if (mpq_sgn(x) == 0) {
+                continue;
+            }
 
+            for (long dcol = dcol0; dcol < dcol1; ++dcol) {
+                mpq_mul(temp, x, matrix_at(dest, row, dcol));
+                mpq_sub(matrix_at(dest, col, dcol), matrix_at(dest, col, dcol), temp);
+            }
+        }
+    }
+}
+
+static void solve_block_u(matrix_t* dest, const matrix_t* src, long dcol0, long dcol1, mpq_ptr temp) {
     long size = src->_rows;
 
-    mpq_t temp;
-    mpq_init(temp);
+    for (long row = size - 1; row >= 0; --row) {
+        for (long col = size - 1; col > row; --col) {
+            mpq_srcptr x = matrix_cat(src, row, col);
 
-    for (long dcol = 0; dcol < dest->_cols; ++dcol) {
-        for (long row = size - 1; row >= 0; --row) {
-            for (long col = size - 1; col > row; --col) {
-                mpq_mul(temp, matrix_cat(src, col, row), matrix_at(dest, col, dcol));
+            if (mpq_sgn(x) == 0) {
+                continue;
+            }
+
+            for (long dcol = dcol0; dcol < dcol1; ++dcol) {
+                mpq_mul(temp, x, matrix_at(dest, col, dcol));
                 mpq_sub(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), temp);
             }
         }
+
+        for (long dcol = dcol0; dcol < dcol1; ++dcol) {
+            mpq_div(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), matrix_cat(src, row, row));
+        }
     }
+}
 
-    mpq_clear(temp);
+static void solve_block_ut(matrix_t* dest, const matrix_t* src, long dcol0, long dcol1, mpq_ptr temp) {
+    long size = src->_rows;
+
+    for (long row = 0; row < size; ++row) {
+        for (long dcol = dcol0; dcol < dcol1; ++dcol) {
+            mpq_div(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), matrix_cat(src, row, row));
+        }
+
+        for (long col = row + 1; col < size; ++col) {
+            mpq_srcptr x = matrix_cat(src, row, col);
+
+            if (mpq_sgn(x) == 0) {
+                continue;
+            }
+
+            for (long dcol = dcol0; dcol < dcol1; ++dcol) {
+                mpq_mul(temp, x, matrix_at(dest, row, dcol));
+                mpq_sub(matrix_at(dest, col, dcol), matrix_at(dest, col, dcol), temp);
+            }
+        }
+    }
 }
 
-void solve_u(matrix_t* dest, const matrix_t* src) {
-    assert(src->_rows == src->_cols);
-    assert(dest->_rows == src->_rows);
+typedef struct {
+    matrix_t* dest;
+    const matrix_t* src;
+    solve_block_t kernel;
+    long dcol0;
+    long dcol1;
+} solve_info_t;
 
-    long size = src->_rows;
+static void* solve_thread(void* data) {
+    solve_info_t* info = data;
 
     mpq_t temp;
     mpq_init(temp);
 
-    for (long dcol = 0; dcol < dest->_cols; ++dcol) {
-        for (long row = size - 1; row >= 0; --row) {
-            for (long col = size - 1; col > row; --col) {
-                mpq_mul(temp, matrix_cat(src, row, col), matrix_at(dest, col, dcol));
-                mpq_sub(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), temp);
-            }
+    NUMSTATS_ENTER(NUMSTATS_SOLVE);
 
-            mpq_div(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), matrix_cat(src, row, row));
-        }
+    for (long dcol = info->dcol0; dcol < info->dcol1; dcol += SOLVE_BLOCK) {
+        long dcol1 = dcol + SOLVE_BLOCK < info->dcol1 ? dcol + SOLVE_BLOCK : info->dcol1;
+        info->kernel(info->dest, info->src, dcol, dcol1, temp);
     }
 
+    NUMSTATS_LEAVE();
     mpq_clear(temp);
+
+    return NULL;
 }
 
-void solve_ut(matrix_t* dest, const matrix_t* src) {
+// right hand side columns are independent, so they are split into contiguous
+// runs of whole blocks, one run per thread.
+static void solve_parallel(matrix_t* dest, const matrix_t* src, solve_block_t kernel, long thread_max) {
     assert(src->_rows == src->_cols);
     assert(dest->_rows == src->_rows);
 
     long size = src->_rows;
+    long blocks = (dest->_cols + SOLVE_BLOCK - 1) / SOLVE_BLOCK;
+    long threads = size * size * dest->_cols < SOLVE_PARALLEL_MIN || thread_max < 1 ? 1 : thread_max;
 
-    mpq_t temp;
-    mpq_init(temp);
+    if (threads > blocks) {
+        threads = blocks < 1 ? 1 : blocks;
+    }
 
-    for (long dcol = 0; dcol < dest->_cols; ++dcol) {
-        for (long row = 0; row < size; ++row) {
-            for (long col = 0; col < row; ++col) {
-                mpq_mul(temp, matrix_cat(src, col, row), matrix_at(dest, col, dcol));
-                mpq_sub(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), temp);
-            }
+    solve_info_t infos[threads];
+    pthread_t handles[threads];
+    bool started[threads];
 
-            mpq_div(matrix_at(dest, row, dcol), matrix_at(dest, row, dcol), matrix_cat(src, row, row));
+    for (long thread = 0; thread < threads; ++thread) {
+        infos[thread].dest = dest;
+        infos[thread].src = src;
+        infos[thread].kernel = kernel;
+        infos[thread].dcol0 = blocks * thread / threads * SOLVE_BLOCK;
+        infos[thread].dcol1 = blocks * (thread + 1) / threads * SOLVE_BLOCK;
+
+        if (infos[thread].dcol1 > dest->_cols) {
+            infos[thread].dcol1 = dest->_cols;
         }
+
+        started[thread] = thread != 0 && pthread_create(&handles[thread], NULL, solve_thread, &infos[thread]) == 0;
     }
 
-    mpq_clear(temp);
+    // the caller solves its own run and those of threads that did not start
+    for (long thread = 0; thread < threads; ++thread) {
+        if (!started[thread]) {
+            solve_thread(&infos[thread]);
+        }
+    }
+
+    for (long thread = 1; thread < threads; ++thread) {
+        if (started[thread]) {
+            pthread_join(handles[thread], NULL);
+        }
+    }
+}
+
+void solve_l(matrix_t* dest, const matrix_t* src, long thread_max) {
+    solve_parallel(dest, src, solve_block_l, thread_max);
+}
+
+void solve_lt(matrix_t* dest, const matrix_t* src, long thread_max) {
+    solve_parallel(dest, src, solve_block_lt, thread_max);
+}
+
+void solve_u(matrix_t* dest, const matrix_t* src, long thread_max) {
+    solve_parallel(dest, src, solve_block_u, thread_max);
+}
+
+void solve_ut(matrix_t* dest, const matrix_t* src, long thread_max) {
+    solve_parallel(dest, src, solve_block_ut, thread_max);
 }
 
-void solve_ptlu(matrix_t* dest, const matrix_t* src, const long* pivots) {
+void solve_ptlu(matrix_t* dest, const matrix_t* src, const long* pivots, long thread_max) {
     assert(src->_rows == src->_cols);
     assert(dest->_rows == src->_rows);
 
     solve_pt(dest, pivots);
-    solve_l(dest, src);
-    solve_u(dest, src);
+    solve_l(dest, src, thread_max);
+    solve_u(dest, src, thread_max);
 }
 
-void solve_utltp(matrix_t* dest, const matrix_t* src, const long* pivots) {
+void solve_utltp(matrix_t* dest, const matrix_t* src, const long* pivots, long thread_max) {
     assert(src->_rows == src->_cols);
     assert(dest->_rows == src->_rows);
 
-    solve_ut(dest, src);
-    solve_lt(dest, src);
+    solve_ut(dest, src, thread_max);
+    solve_lt(dest, src, thread_max);
     solve_p(dest, pivots);
 }
 
@@ -7,14 +7,99 @@
 #include <stdlib.h>
 
 #include "la.h"
-
-static void lp_pivot(matrix_t* table, long* B, long* N, long variables, long constraints, long entering, long exiting) {
+#include "lp.h"
+
+// table widths (columns besides b) with a specialized kernel
+#define LP_FIXED_MIN 3
+#define LP_FIXED_MAX 20
+
+#define LP_DIMENSION 3
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 4
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 5
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 6
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 7
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 8
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 9
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 10
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 11
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 12
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 13
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 14
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 15
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 16
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 17
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 18
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 19
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+#define LP_DIMENSION 20
+#include "lp_fixed.h"
+#undef LP_DIMENSION
+
+typedef void (*lp_run_fixed_t)(mpq_t* data, long rows, long* B, long* N, long constraints, const matrix_t* upper, long bounded, bool* flipped);
+
+static const lp_run_fixed_t lp_run_fixed[LP_FIXED_MAX + 1] = {
+    [3] = lp_run_fixed_3,
+    [4] = lp_run_fixed_4,
+    [5] = lp_run_fixed_5,
+    [6] = lp_run_fixed_6,
+    [7] = lp_run_fixed_7,
+    [8] = lp_run_fixed_8,
+    [9] = lp_run_fixed_9,
+    [10] = lp_run_fixed_10,
+    [11] = lp_run_fixed_11,
+    [12] = lp_run_fixed_12,
+    [13] = lp_run_fixed_13,
+    [14] = lp_run_fixed_14,
+    [15] = lp_run_fixed_15,
+    [16] = lp_run_fixed_16,
+    [17] = lp_run_fixed_17,
+    [18] = lp_run_fixed_18,
+    [19] = lp_run_fixed_19,
+    [20] = lp_run_fixed_20,
+};
+
+void lp_pivot(matrix_t* table, long* B, long* N, long variables, long constraints, long entering, long exiting) {
     const long a = matrix_rows(table) - constraints;
     const long b = matrix_cols(table) - 1;
 
     assert(0 <= entering && entering < b);
     assert(0 <= exiting && exiting < constraints);
 
+    NUMSTATS_ENTER(NUMSTATS_LP_PIVOT);
+
     mpq_t t0;
     mpq_init(t0);
 
@@ -64,14 +149,55 @@ static void lp_pivot(matrix_t* table, long* B, long* N, long variables, long con
 
     mpq_clear(t0);
     mpq_clear(t1);
+
+    NUMSTATS_LEAVE();
+}
+
+// complements the nonbasic variable of column col, x -> upper - x, which
+// moves it from one bound to the other while it stays at zero in the table
+static void lp_flip_column(matrix_t* table, long* N, const matrix_t* upper, bool* flipped, long col, mpq_ptr t0) {
+    const long b = matrix_cols(table) - 1;
+    mpq_srcptr bound = matrix_cat(upper, N[col], 0);
+
+    for (long row = 0; row < matrix_rows(table); ++row) {
+        mpq_ptr x = matrix_at(table, row, col);
+
+        mpq_mul(t0, x, bound);
+        mpq_sub(matrix_at(table, row, b), matrix_at(table, row, b), t0);
+        mpq_neg(x, x);
+    }
+
+    flipped[N[col]] = !flipped[N[col]];
+}
+
+// complements the basic variable of row exiting
+static void lp_flip_row(matrix_t* table, long* B, long constraints, const matrix_t* upper, bool* flipped, long exiting) {
+    const long row = matrix_rows(table) - constraints + exiting;
+    const long b = matrix_cols(table) - 1;
+
+    for (long col = 0; col < b; ++col) {
+        mpq_neg(matrix_at(table, row, col), matrix_at(table, row, col));
+    }
+
+    mpq_sub(matrix_at(table, row, b), matrix_cat(upper, B[exiting], 0), matrix_at(table, row, b));
+
+    flipped[B[exiting]] = !flipped[B[exiting]];
 }
 
 // B: row    -> variable
 // N: column -> variable
-static bool lp_step(matrix_t* table, long* B, long* N, long variables, long constraints) {
+//
+// variables [0, bounded) also have an upper bound in upper. one of them is
+// complemented while flipped is set, so every nonbasic variable stays at zero
+// and every basic one within [0, upper]. the entering variable stops at the
+// first of its own bound (it flips) or a basic variable reaching either of
+// its bounds (which leaves, flipped first if at its upper bound).
+static bool lp_step(matrix_t* table, long* B, long* N, long variables, long constraints, const matrix_t* upper, long bounded, bool* flipped) {
     const long a = matrix_rows(table) - constraints; // first row of A
     const long b = matrix_cols(table) - 1;           // first col of b
 
+    NUMSTATS_ENTER(NUMSTATS_LP_STEP);
+
     mpq_t t0;
     mpq_init(t0);
 
@@ -81,7 +207,9 @@ static bool lp_step(matrix_t* table, long* B, long* N, long variables, long cons
     bool bland = false;
 
     for (long row = 0; row < constraints; ++row) {
-        if (mpq_sgn(matrix_at(table, a + row, b)) == 0) {
+        mpq_srcptr y = matrix_at(table, a + row, b);
+
+        if (mpq_sgn(y) == 0 || (B[row] < bounded && mpq_equal(y, matrix_cat(upper, B[row], 0)))) {
             bland = true;
             break;
         }
@@ -107,11 +235,18 @@ static bool lp_step(matrix_t* table, long* B, long* N, long variables, long cons
         mpq_clear(t0);
         mpq_clear(t1);
 
+        NUMSTATS_LEAVE();
         return true;
     }
 
-    // row, [0, constraints]
+    // row, [0, constraints), or -1 for a bound flip
     long exiting = -1;
+    bool limited = N[entering] < bounded;
+    bool at_upper = false;
+
+    if (limited) {
+        mpq_set(t0, matrix_cat(upper, N[entering], 0));
+    }
 
     for (long row = 0; row < constraints; ++row) {
         mpq_ptr x = matrix_at(table, a + row, entering);
@@ -119,78 +254,307 @@ static bool lp_step(matrix_t* table, long* B, long* N, long variables, long cons
 
         if (mpq_sgn(x) > 0) {
             mpq_div(t1, y, x);
+        } else if (mpq_sgn(x) < 0 && B[row] < bounded) {
+            mpq_sub(t1, y, matrix_cat(upper, B[row], 0));
+            mpq_div(t1, t1, x);
+        } else {
+            continue;
+        }
 
-            if (exiting == -1 || mpq_cmp(t1, t0) < 0) {
-                exiting = row;
-                mpq_set(t0, t1);
-            }
+        if (!limited || mpq_cmp(t1, t0) < 0) {
+            exiting = row;
+            at_upper = mpq_sgn(x) < 0;
+            limited = true;
+            mpq_set(t0, t1);
         }
     }
 
-    assert(exiting != -1);
+    assert(limited);
+
+    if (exiting == -1) {
+        lp_flip_column(table, N, upper, flipped, entering, t1);
+    } else {
+        if (at_upper) {
+            lp_flip_row(table, B, constraints, upper, flipped, exiting);
+        }
+
+        lp_pivot(table, B, N, variables, constraints, entering, exiting);
+    }
 
     mpq_clear(t0);
     mpq_clear(t1);
 
-    // printf("entering, exiting: %ld, %ld\n", entering, exiting);
+    NUMSTATS_LEAVE();
+    return false;
+}
 
-    lp_pivot(table, B, N, variables, constraints, entering, exiting);
+// steps until optimal, on the kernel specialized for the table's width if
+// there is one and the table is not a narrower view of a wider one
+static void lp_run(matrix_t* table, long* B, long* N, long variables, long constraints, const matrix_t* upper, long bounded, bool* flipped) {
+    long stride;
+    mpq_t* data = matrix_data(table, &stride);
+    long width = matrix_cols(table) - 1;
 
-    return false;
+    if (stride == matrix_cols(table) && LP_FIXED_MIN <= width && width <= LP_FIXED_MAX) {
+        lp_run_fixed[width](data, matrix_rows(table), B, N, constraints, upper, bounded, flipped);
+        return;
+    }
+
+    while (!lp_step(table, B, N, variables, constraints, upper, bounded, flipped)) {
+        //
+    }
 }
 
-void lp_solve(matrix_t* dest, const matrix_t* initial_table, long dimensions, long depth) {
-    assert(matrix_rows(dest) == dimensions);
+// where an optimal table has nonbasic variables s at zero (complemented ones
+// included), a form q = f x + f0 is q* + sum a_k s_k. if q is an integer at
+// every integer point but q* is not, with fractional part f0 > 0, either q <=
+// floor(q*) or q >= ceil(q*), and both imply the gomory mixed-integer cut
+// sum max(a_k / (1 - f0), -a_k / f0) s_k >= 1. it is written over x by
+// substituting the structural variables and each slack s = b - a x.
+static long lp_gomory(matrix_t* cuts_out, const matrix_t* forms, const matrix_t* initial_table, const matrix_t* upper, const matrix_t* x, long variables,
+                      matrix_t* table, long remaining, long constraints, const long* B, const long* N, const bool* flipped, const long* origin) {
+    long count = 0;
+
+    mpq_t q;
+    mpq_t f0;
+    mpq_t a;
+    mpq_t g;
+    mpq_t t0;
+
+    mpq_init(q);
+    mpq_init(f0);
+    mpq_init(a);
+    mpq_init(g);
+    mpq_init(t0);
+
+    for (long form = 0; form < matrix_rows(forms); ++form) {
+        mpq_set(q, matrix_cat(forms, form, variables));
+
+        for (long i = 0; i < variables; ++i) {
+            mpq_mul(t0, matrix_cat(forms, form, i), matrix_cat(x, i, 0));
+            mpq_add(q, q, t0);
+        }
+
+        // f0 = q - floor(q)
+        mpz_fdiv_r(mpq_numref(f0), mpq_numref(q), mpq_denref(q));
+        mpz_set(mpq_denref(f0), mpq_denref(q));
+        mpq_canonicalize(f0);
+
+        if (mpq_sgn(f0) == 0) {
+            continue;
+        }
+
+        // a cut 0 >= 1 is right too: no integer point has this q
+        matrix_t* cut = matrix_view(cuts_out, count, 0, 1, variables + 1);
+
+        for (long col = 0; col < variables; ++col) {
+            mpq_set_ui(matrix_at(cut, 0, col), 0, 1);
+        }
+
+        mpq_set_si(matrix_at(cut, 0, variables), -1, 1);
+
+        for (long k = 0; k < remaining; ++k) {
+            mpq_set_ui(a, 0, 1);
+
+            if (N[k] < variables) {
+                mpq_set(a, matrix_cat(forms, form, N[k]));
+
+                if (flipped[N[k]]) {
+                    mpq_neg(a, a);
+                }
+            }
+
+            for (long row = 0; row < constraints; ++row) {
+                if (B[row] < variables) {
+                    mpq_mul(t0, matrix_cat(forms, form, B[row]), matrix_at(table, 2 + row, k));
+
+                    if (flipped[B[row]]) {
+                        mpq_add(a, a, t0);
+                    } else {
+                        mpq_sub(a, a, t0);
+                    }
+                }
+            }
+
+            if (mpq_sgn(a) > 0) {
+                mpq_set_ui(t0, 1, 1);
+                mpq_sub(t0, t0, f0);
+                mpq_div(g, a, t0);
+            } else if (mpq_sgn(a) < 0) {
+                mpq_div(g, a, f0);
+                mpq_neg(g, g);
+            } else {
+                continue;
+            }
+
+            // -g s moves to the left of a x <= b
+            if (N[k] < variables && !flipped[N[k]]) {
+                mpq_sub(matrix_at(cut, 0, N[k]), matrix_at(cut, 0, N[k]), g);
+            } else if (N[k] < variables) {
+                mpq_add(matrix_at(cut, 0, N[k]), matrix_at(cut, 0, N[k]), g);
+                mpq_mul(t0, g, matrix_cat(upper, N[k], 0));
+                mpq_add(matrix_at(cut, 0, variables), matrix_at(cut, 0, variables), t0);
+            } else {
+                long row = origin[N[k]];
+
+                for (long col = 0; col <= variables; ++col) {
+                    mpq_mul(t0, g, matrix_cat(initial_table, row, col));
+                    mpq_add(matrix_at(cut, 0, col), matrix_at(cut, 0, col), t0);
+                }
+            }
+        }
+
+        matrix_free(cut);
+        ++count;
+    }
+
+    mpq_clear(q);
+    mpq_clear(f0);
+    mpq_clear(a);
+    mpq_clear(g);
+    mpq_clear(t0);
+
+    return count;
+}
+
+// initial_table holds the objective in row 0, then inequalities rows of
+// a x <= b and equalities rows of a x = b, with b in the last column, over
+// variables nonnegative variables, each also at most its entry of upper
+// unless upper is NULL. the upper bounds take no rows: the simplex keeps them
+// by complementing variables. inequalities with b >= 0 start with their
+// slack basic; the others get a surplus column and, like the equalities, an
+// artificial variable that phase one drives to zero.
+bool lp_solve_cuts(matrix_t* dest, const matrix_t* initial_table, const matrix_t* upper, long variables, long inequalities, long equalities, const matrix_t* forms, matrix_t* cuts_out, long* cut_count_out) {
+    assert(matrix_rows(dest) == variables);
     assert(matrix_cols(dest) == 1);
+    assert(!upper || matrix_rows(upper) == variables);
+    assert(matrix_rows(initial_table) >= 1 + inequalities + equalities);
+    assert(matrix_cols(initial_table) == variables + 1);
+
+    NUMSTATS_ENTER(NUMSTATS_LP_SOLVE);
+
+    if (cut_count_out) {
+        *cut_count_out = 0;
+    }
+
+    long surplus = 0;
+
+    for (long row = 1; row <= inequalities; ++row) {
+        if (mpq_sgn(matrix_cat(initial_table, row, variables)) < 0) {
+            ++surplus;
+        }
+    }
+
+    const long columns = variables + surplus;          // structural, including surplus
+    const long slacks = inequalities - surplus;        // rows starting with a basic slack
+    const long artificials = surplus + equalities;     // rows starting with a basic artificial
+    const long constraints = slacks + artificials;
+    const long b = columns;                            // rhs column
+
+    matrix_t* table = matrix_alloc(2 + constraints, columns + 1);
+
+    // row 1 (Z)
+    for (long col = 0; col < variables; ++col) {
+        mpq_set(matrix_at(table, 1, col), matrix_cat(initial_table, 0, col));
+    }
+
+    mpq_set(matrix_at(table, 1, b), matrix_cat(initial_table, 0, variables));
+
+    // inequality row of each slack and surplus variable, for the cuts
+    long origin[columns + constraints];
+
+    // rows [2, 2 + constraints) (A), slack rows first
+    for (long row = 1, slack = 0, artificial = 0; row <= inequalities + equalities; ++row) {
+        mpq_srcptr rhs = matrix_cat(initial_table, row, variables);
+        bool negate = mpq_sgn(rhs) < 0;
+        long dest_row = 2 + (row <= inequalities && !negate ? slack++ : slacks + artificial++);
 
-    matrix_t* table = matrix_alloc(2 + dimensions + depth, dimensions + 1);
+        if (row <= inequalities) {
+            origin[negate ? variables + artificial - 1 : columns + dest_row - 2] = row;
+        }
+
+        for (long col = 0; col < variables; ++col) {
+            if (negate) {
+                mpq_neg(matrix_at(table, dest_row, col), matrix_cat(initial_table, row, col));
+            } else {
+                mpq_set(matrix_at(table, dest_row, col), matrix_cat(initial_table, row, col));
+            }
+        }
 
-    // row [1, 2 + size + depth) (Z and A)
-    for (long row = 1; row < 2 + dimensions + depth; ++row) {
-        for (long col = 0; col < dimensions + 1; ++col) {
-            mpq_set(matrix_at(table, row, col), matrix_cat(initial_table, row - 1, col));
+        if (negate) {
+            mpq_neg(matrix_at(table, dest_row, b), rhs);
+        } else {
+            mpq_set(matrix_at(table, dest_row, b), rhs);
+        }
+
+        // a x + s = b with b < 0 becomes -a x - s = -b
+        if (row <= inequalities && negate) {
+            mpq_set_si(matrix_at(table, dest_row, variables + artificial - 1), -1, 1);
         }
     }
 
     // row 0 (for finding initial basis)
-    for (long row = dimensions; row < dimensions + depth; ++row) {
-        for (long col = 0; col < dimensions + 1; ++col) {
+    for (long row = slacks; row < constraints; ++row) {
+        for (long col = 0; col < columns + 1; ++col) {
             mpq_add(matrix_at(table, 0, col), matrix_at(table, 0, col), matrix_at(table, 2 + row, col));
         }
     }
 
-    long B[dimensions + depth];
-    long N[dimensions];
+    long B[constraints > 0 ? constraints : 1];
+    long N[columns];
+    bool flipped[columns + constraints];
+    const long bounded = upper ? variables : 0;
+
+    for (long i = 0; i < columns + constraints; ++i) {
+        flipped[i] = false;
 
-    for (long i = 0; i < 2 * dimensions + depth; ++i) {
-        if (i < dimensions) {
+        if (i < columns) {
             N[i] = i;
         } else {
-            B[i - dimensions] = i;
+            B[i - columns] = i;
         }
     }
 
-    while (!lp_step(table, B, N, 2 * dimensions + depth, dimensions + depth)) {
-        //
+    const long first_artificial = columns + slacks;
+
+    lp_run(table, B, N, columns + constraints, constraints, upper, bounded, flipped);
+
+    // the remaining infeasibility is the sum of the artificials
+    if (mpq_sgn(matrix_at(table, 0, b)) != 0) {
+        matrix_free(table);
+
+        NUMSTATS_LEAVE();
+        return false;
     }
 
-    for (long row = 0; row < dimensions + depth; ++row) {
-        if (B[row] >= 2 * dimensions) {
-            assert(mpq_sgn(matrix_at(table, 2 + row, dimensions)) == 0);
+    for (long row = 0; row < constraints; ++row) {
+        if (B[row] >= first_artificial) {
+            assert(mpq_sgn(matrix_at(table, 2 + row, b)) == 0);
 
-            for (long col = 0; col < dimensions; ++col) {
-                if (N[col] < 2 * dimensions && mpq_sgn(matrix_at(table, 2 + row, col)) != 0) {
-                    lp_pivot(table, B, N, 2 * dimensions + depth, dimensions + depth, col, row);
+            for (long col = 0; col < columns; ++col) {
+                if (N[col] < first_artificial && mpq_sgn(matrix_at(table, 2 + row, col)) != 0) {
+                    lp_pivot(table, B, N, columns + constraints, constraints, col, row);
+                    break;
                 }
             }
         }
     }
 
-    for (long c0 = 0, c1 = dimensions - 1; c0 < dimensions - depth; ++c0) {
-        if (N[c0] >= 2 * dimensions) {
+    // an artificial still basic here sits on a redundant row of zeros, so
+    // phase two keeps one column per nonbasic non-artificial variable
+    long remaining = 0;
+
+    for (long col = 0; col < columns; ++col) {
+        if (N[col] < first_artificial) {
+            ++remaining;
+        }
+    }
+
+    for (long c0 = 0, c1 = columns - 1; c0 < remaining; ++c0) {
+        if (N[c0] >= first_artificial) {
             for (;; --c1) {
-                if (N[c1] < 2 * dimensions) {
-                    for (long row = 0; row < 2 + dimensions + depth; ++row) {
+                if (N[c1] < first_artificial) {
+                    for (long row = 0; row < 2 + constraints; ++row) {
                         mpq_swap(matrix_at(table, row, c0), matrix_at(table, row, c1));
                     }
 
@@ -204,26 +568,48 @@ void lp_solve(matrix_t* dest, const matrix_t* initial_table, long dimensions, lo
         }
     }
 
-    for (long row = 0; row < 2 + dimensions + depth; ++row) {
-        mpq_swap(matrix_at(table, row, dimensions - depth), matrix_at(table, row, dimensions));
+    for (long row = 0; row < 2 + constraints; ++row) {
+        mpq_swap(matrix_at(table, row, remaining), matrix_at(table, row, b));
     }
 
-    matrix_t* view = matrix_view(table, 1, 0, 1 + dimensions + depth, dimensions - depth + 1);
+    matrix_t* view = matrix_view(table, 1, 0, 1 + constraints, remaining + 1);
 
-    while (!lp_step(view, B, N, 2 * dimensions, dimensions + depth)) {
-        //
-    }
+    lp_run(view, B, N, first_artificial, constraints, upper, bounded, flipped);
 
-    for (long i = 0; i < dimensions; ++i) {
+    // a complemented variable is upper - its value in the table
+    for (long i = 0; i < variables; ++i) {
         mpq_set_ui(matrix_at(dest, i, 0), 0, 1);
     }
 
-    for (long i = 0; i < dimensions + depth; ++i) {
-        if (B[i] < dimensions) {
-            mpq_set(matrix_at(dest, B[i], 0), matrix_at(table, 2 + i, dimensions - depth));
+    for (long col = 0; col < columns; ++col) {
+        if (N[col] < bounded && flipped[N[col]]) {
+            mpq_set(matrix_at(dest, N[col], 0), matrix_cat(upper, N[col], 0));
         }
     }
 
+    for (long i = 0; i < constraints; ++i) {
+        if (B[i] < variables) {
+            mpq_ptr x = matrix_at(dest, B[i], 0);
+
+            if (B[i] < bounded && flipped[B[i]]) {
+                mpq_sub(x, matrix_cat(upper, B[i], 0), matrix_at(table, 2 + i, remaining));
+            } else {
+                mpq_set(x, matrix_at(table, 2 + i, remaining));
+            }
+        }
+    }
+
+    if (forms) {
+        *cut_count_out = lp_gomory(cuts_out, forms, initial_table, upper, dest, variables, table, remaining, constraints, B, N, flipped, origin);
+    }
+
     matrix_free(view);
     matrix_free(table);
+
+    NUMSTATS_LEAVE();
+    return true;
+}
+
+bool lp_solve(matrix_t* dest, const matrix_t* initial_table, const matrix_t* upper, long variables, long inequalities, long equalities) {
+    return lp_solve_cuts(dest, initial_table, upper, variables, inequalities, equalities, NULL, NULL, NULL);
 }
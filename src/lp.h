@@ -7,4 +7,11 @@
 
 #include "la.h"
 
-void lp_solve(matrix_t* dest, const matrix_t* initial_table, long dimensions, long depth);
+void lp_pivot(matrix_t* table, long* B, long* N, long variables, long constraints, long entering, long exiting);
+bool lp_solve(matrix_t* dest, const matrix_t* initial_table, const matrix_t* upper, long variables, long inequalities, long equalities);
+
+// lp_solve(), and for each row f of forms (mpq_t[forms][variables + 1]) whose
+// q = f x + f_variables is an integer at every integer point but not at the
+// optimum, a gomory mixed-integer cut a x <= b from the optimal table that
+// cuts the optimum off. cuts_out receives *cut_count_out rows of a and b.
+bool lp_solve_cuts(matrix_t* dest, const matrix_t* initial_table, const matrix_t* upper, long variables, long inequalities, long equalities, const matrix_t* forms, matrix_t* cuts_out, long* cut_count_out);
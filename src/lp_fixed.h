@@ -0,0 +1,177 @@
+// lp_step() and lp_pivot() for dense tables of exactly LP_DIMENSION + 1
+// columns. lp.c includes this once per specialized dimension, defining
+// LP_DIMENSION before each inclusion, so the column loops have constant
+// bounds the compiler can unroll, and rows are reached by a constant stride
+// instead of through matrix_at().
+
+#define LP_COLS (LP_DIMENSION + 1)
+#define LP_PASTE(name, dimension) name##_##dimension
+#define LP_EXPAND(name, dimension) LP_PASTE(name, dimension)
+#define LP_FIXED(name) LP_EXPAND(name, LP_DIMENSION)
+
+static void LP_FIXED(lp_pivot_fixed)(mpq_t* data, long rows, long a, long* B, long* N, long entering, long exiting, mpq_ptr t0) {
+    NUMSTATS_ENTER(NUMSTATS_LP_PIVOT);
+
+    mpq_t* pivot_row = data + (a + exiting) * LP_COLS;
+    mpq_ptr pivot = pivot_row[entering];
+
+    for (long col = 0; col < LP_COLS; ++col) {
+        if (col != entering) {
+            mpq_div(pivot_row[col], pivot_row[col], pivot);
+        }
+    }
+
+    for (long row = 0; row < rows; ++row) {
+        mpq_t* current = data + row * LP_COLS;
+        mpq_ptr x = current[entering];
+
+        // a zero in the entering column leaves the row unchanged
+        if (row == a + exiting || mpq_sgn(x) == 0) {
+            continue;
+        }
+
+        for (long col = 0; col < LP_COLS; ++col) {
+            if (col != entering) {
+                mpq_mul(t0, x, pivot_row[col]);
+                mpq_sub(current[col], current[col], t0);
+            }
+        }
+
+        mpq_div(x, x, pivot);
+        mpq_neg(x, x);
+    }
+
+    mpq_inv(pivot, pivot);
+
+    long _entering = N[entering];
+    long _exiting = B[exiting];
+
+    N[entering] = _exiting;
+    B[exiting] = _entering;
+
+    NUMSTATS_LEAVE();
+}
+
+static void LP_FIXED(lp_flip_column_fixed)(mpq_t* data, long rows, long* N, const matrix_t* upper, bool* flipped, long col, mpq_ptr t0) {
+    mpq_srcptr bound = matrix_cat(upper, N[col], 0);
+
+    for (long row = 0; row < rows; ++row) {
+        mpq_t* current = data + row * LP_COLS;
+
+        mpq_mul(t0, current[col], bound);
+        mpq_sub(current[LP_COLS - 1], current[LP_COLS - 1], t0);
+        mpq_neg(current[col], current[col]);
+    }
+
+    flipped[N[col]] = !flipped[N[col]];
+}
+
+static void LP_FIXED(lp_flip_row_fixed)(mpq_t* data, long a, long* B, const matrix_t* upper, bool* flipped, long exiting) {
+    mpq_t* current = data + (a + exiting) * LP_COLS;
+
+    for (long col = 0; col < LP_COLS - 1; ++col) {
+        mpq_neg(current[col], current[col]);
+    }
+
+    mpq_sub(current[LP_COLS - 1], matrix_cat(upper, B[exiting], 0), current[LP_COLS - 1]);
+
+    flipped[B[exiting]] = !flipped[B[exiting]];
+}
+
+// steps until optimal, with the same pivoting and bound rules as lp_step()
+static void LP_FIXED(lp_run_fixed)(mpq_t* data, long rows, long* B, long* N, long constraints, const matrix_t* upper, long bounded, bool* flipped) {
+    const long a = rows - constraints; // first row of A
+    const long b = LP_COLS - 1;        // col of b
+
+    NUMSTATS_ENTER(NUMSTATS_LP_STEP);
+
+    mpq_t t0;
+    mpq_init(t0);
+
+    mpq_t t1;
+    mpq_init(t1);
+
+    for (;;) {
+        bool bland = false;
+
+        for (long row = 0; row < constraints; ++row) {
+            mpq_ptr y = data[(a + row) * LP_COLS + b];
+
+            if (mpq_sgn(y) == 0 || (B[row] < bounded && mpq_equal(y, matrix_cat(upper, B[row], 0)))) {
+                bland = true;
+                break;
+            }
+        }
+
+        long entering = -1;
+
+        for (long col = 0; col < b; ++col) {
+            mpq_ptr x = data[col];
+
+            if (mpq_sgn(x) > 0 && (entering == -1 || mpq_cmp(x, t0) > 0)) {
+                entering = col;
+                mpq_set(t0, x);
+
+                if (bland) {
+                    break;
+                }
+            }
+        }
+
+        if (entering == -1) {
+            break;
+        }
+
+        long exiting = -1;
+        bool limited = N[entering] < bounded;
+        bool at_upper = false;
+
+        if (limited) {
+            mpq_set(t0, matrix_cat(upper, N[entering], 0));
+        }
+
+        for (long row = 0; row < constraints; ++row) {
+            mpq_ptr x = data[(a + row) * LP_COLS + entering];
+            mpq_ptr y = data[(a + row) * LP_COLS + b];
+
+            if (mpq_sgn(x) > 0) {
+                mpq_div(t1, y, x);
+            } else if (mpq_sgn(x) < 0 && B[row] < bounded) {
+                mpq_sub(t1, y, matrix_cat(upper, B[row], 0));
+                mpq_div(t1, t1, x);
+            } else {
+                continue;
+            }
+
+            if (!limited || mpq_cmp(t1, t0) < 0) {
+                exiting = row;
+                at_upper = mpq_sgn(x) < 0;
+                limited = true;
+                mpq_set(t0, t1);
+            }
+        }
+
+        assert(limited);
+
+        if (exiting == -1) {
+            LP_FIXED(lp_flip_column_fixed)(data, rows, N, upper, flipped, entering, t1);
+            continue;
+        }
+
+        if (at_upper) {
+            LP_FIXED(lp_flip_row_fixed)(data, a, B, upper, flipped, exiting);
+        }
+
+        LP_FIXED(lp_pivot_fixed)(data, rows, a, B, N, entering, exiting, t0);
+    }
+
+    mpq_clear(t0);
+    mpq_clear(t1);
+
+    NUMSTATS_LEAVE();
+}
+
+#undef LP_COLS
+#undef LP_PASTE
+#undef LP_EXPAND
+#undef LP_FIXED
@@ -3,14 +3,22 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <gmp.h>
 #include <unistd.h>
 
+#include "affinity.h"
+#include "batch.h"
 #include "parse.h"
 #include "enumerate.h"
 #include "la.h"
-#include "lp.h"
+#include "numstats.h"
+#include "output.h"
+#include "sphere.h"
+#include "trace.h"
 
 static void get_duration(const struct timespec* start, const struct timespec* end, long* d_out, long* h_out, long* m_out, long* s_out, long* ms_out, long* us_out, long* ns_out) {
     long s = end->tv_sec - start->tv_sec;
@@ -31,91 +39,372 @@ static void get_duration(const struct timespec* start, const struct timespec* en
     if (d_out != NULL) *d_out = s / 60 / 60 / 24;
 }
 
-static void test(void) {
-    matrix_t* table = matrix_alloc(6, 5);
-    matrix_t* x = matrix_alloc(4, 1);
-
-    mpq_set_si(matrix_at(table, 0, 0), 1, 2);
-    mpq_set_si(matrix_at(table, 0, 1), 0, 1);
-    mpq_set_si(matrix_at(table, 0, 2), -1, 2);
-    mpq_set_si(matrix_at(table, 0, 3), 1, 2);
-    mpq_set_si(matrix_at(table, 0, 4), 0, 1);
-
-    mpq_set_si(matrix_at(table, 1, 0), 1, 1);
-    mpq_set_si(matrix_at(table, 1, 1), 0, 1);
-    mpq_set_si(matrix_at(table, 1, 2), 0, 1);
-    mpq_set_si(matrix_at(table, 1, 3), 0, 1);
-    mpq_set_si(matrix_at(table, 1, 4), 4, 1);
-
-    mpq_set_si(matrix_at(table, 2, 0), 0, 1);
-    mpq_set_si(matrix_at(table, 2, 1), 1, 1);
-    mpq_set_si(matrix_at(table, 2, 2), 0, 1);
-    mpq_set_si(matrix_at(table, 2, 3), 0, 1);
-    mpq_set_si(matrix_at(table, 2, 4), 4, 1);
-
-    mpq_set_si(matrix_at(table, 3, 0), 0, 1);
-    mpq_set_si(matrix_at(table, 3, 1), 0, 1);
-    mpq_set_si(matrix_at(table, 3, 2), 1, 1);
-    mpq_set_si(matrix_at(table, 3, 3), 0, 1);
-    mpq_set_si(matrix_at(table, 3, 4), 4, 1);
-
-    mpq_set_si(matrix_at(table, 4, 0), 0, 1);
-    mpq_set_si(matrix_at(table, 4, 1), 0, 1);
-    mpq_set_si(matrix_at(table, 4, 2), 0, 1);
-    mpq_set_si(matrix_at(table, 4, 3), 1, 1);
-    mpq_set_si(matrix_at(table, 4, 4), 4, 1);
-
-    mpq_set_si(matrix_at(table, 5, 0), -1, 2);
-    mpq_set_si(matrix_at(table, 5, 1), 0, 1);
-    mpq_set_si(matrix_at(table, 5, 2), 1, 2);
-    mpq_set_si(matrix_at(table, 5, 3), 0, 1);
-    mpq_set_si(matrix_at(table, 5, 4), 1, 1);
-
-    lp_solve(x, table, 4, 1);
-
-    exit(0);
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-w binary_out] [-f text|ranges|binary|none] [-o results_out] [-t threads] [-a all|cpulist] [-n] [-p depth] [-g depth] [-c cache_dir] [-m|-M objective] [-e radius2] [-x] [-l manifest] [-s] [-S stats_out] [-T trace_out] [file|dir...]\n", name);
+    exit(1);
 }
 
-int main(int argc, char** argv) {
-    FILE* stream = stdin;
+// -s prints the numeric statistics after the summary, -S writes them as json
+static void report_numstats(FILE* summary_stream, bool print, const char* json_path) {
+    if (print) {
+        fprintf(summary_stream, "\n");
+        numstats_print(summary_stream);
+    }
 
-    if (argc >= 2) {
-        stream = fopen(argv[1], "r");
+    if (json_path) {
+        FILE* stream = fopen(json_path, "w");
 
-        if (!stream) {
-            fprintf(stderr, "error opening file %s\n", argv[1]);
+        if (!stream || !numstats_write_json(stream) || fclose(stream) != 0) {
+            fprintf(stderr, "error writing file %s\n", json_path);
             exit(1);
         }
     }
+}
 
-    long dimensions;
-    matrix_t* basis;
-    matrix_t* lower;
-    matrix_t* upper;
+// -T writes the spans recorded since trace_enable()
+static void write_trace(const char* path) {
+    if (!path) {
+        return;
+    }
 
-    if (!parse_data(stream, &basis, &lower, &upper)) {
-        fprintf(stderr, "error parsing file %s\n", argc >= 2 ? argv[1] : "(stdin)");
+    FILE* stream = fopen(path, "w");
+
+    if (!stream || !trace_write_json(stream) || fclose(stream) != 0) {
+        fprintf(stderr, "error writing file %s\n", path);
         exit(1);
     }
 
-    fclose(stream);
+    trace_free();
+}
+
+// every instance on one worker pool, with results in results_dir
+static int run_batch(char** paths, long path_count, const char* binary_path, const char* results_dir, output_format_t format, const char* objective_text, bool maximize, const enumerate_options_t* options, bool print_stats, const char* stats_path, const char* trace_path, const char* name) {
+    if (binary_path || (format != OUTPUT_NONE && !results_dir)) {
+        fprintf(stderr, "batch mode writes results to a directory given with -o (or -f none), and does not convert with -w\n");
+        usage(name);
+    }
+
+    if (format != OUTPUT_NONE && !batch_check_names(paths, path_count)) {
+        exit(1);
+    }
+
+    if (results_dir && mkdir(results_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "error creating directory %s\n", results_dir);
+        exit(1);
+    }
+
+    batch_options_t batch;
+
+    batch.format = format;
+    batch.output_dir = results_dir;
+    batch.objective = objective_text;
+    batch.maximize = maximize;
 
     long count = 0;
-    matrix_t** results = NULL;
+
+    struct timespec start;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool success = batch_run(paths, path_count, &batch, options, stdout, &count);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    long elapsed_h;
+    long elapsed_m;
+    long elapsed_s;
+    long elapsed_ms;
+
+    get_duration(&start, &end, NULL, &elapsed_h, &elapsed_m, &elapsed_s, &elapsed_ms, NULL, NULL);
+
+    fprintf(stdout, "\n");
+    fprintf(stdout, "elapsed: %02ld:%02ld:%02ld.%03ld\n", elapsed_h, elapsed_m, elapsed_s, elapsed_ms);
+    fprintf(stdout, "count:   %ld\n", count);
+
+    report_numstats(stdout, print_stats, stats_path);
+    write_trace(trace_path);
+
+    for (long i = 0; i < path_count; ++i) {
+        free(paths[i]);
+    }
+
+    free(paths);
+    free((void*) options->cpus);
+
+    return success ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    const char* binary_path = NULL;
+    const char* results_path = NULL;
+    output_format_t format = OUTPUT_TEXT;
+    long* cpus = NULL;
+    const char* objective_text = NULL;
+    bool maximize = false;
+    char** paths = NULL;
+    long path_count = 0;
+    bool manifest = false;
+    bool print_stats = false;
+    const char* stats_path = NULL;
+    const char* trace_path = NULL;
+    const char* radius_text = NULL;
+    bool linear_pruning = false;
+    int option;
+
+    enumerate_options_t options;
+    enumerate_options_init(&options);
 
 #ifndef NDEBUG
-    long threads = 1;
+    options.thread_max = 1;
+#else
+    options.thread_max = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (getenv("LATTICE_THREADS")) {
+        options.thread_max = strtol(getenv("LATTICE_THREADS"), NULL, 10);
+    }
+
+    while ((option = getopt(argc, argv, "w:f:o:t:a:np:g:c:m:M:e:xl:sS:T:")) != -1) {
+        switch (option) {
+            case 'w':
+                binary_path = optarg;
+                break;
+            case 'f':
+                if (!output_parse_format(optarg, &format)) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'o':
+                results_path = optarg;
+                break;
+            case 't':
+                options.thread_max = strtol(optarg, NULL, 10);
+                break;
+            case 'a':
+                free(cpus);
+
+                if (!affinity_parse(optarg, &cpus, &options.cpu_count)) {
+                    fprintf(stderr, "invalid cpu list %s, or one naming a cpu this process may not run on\n", optarg);
+                    exit(1);
+                }
+
+                options.cpus = cpus;
+                break;
+            case 'n':
+                options.numa_local = true;
+                break;
+            case 'p':
+                options.presolve_depth = strtol(optarg, NULL, 10);
+                break;
+            case 'g':
+                options.cut_depth = strtol(optarg, NULL, 10);
+                break;
+            case 'c':
+                if (mkdir(optarg, 0777) != 0 && errno != EEXIST) {
+                    fprintf(stderr, "error creating directory %s\n", optarg);
+                    exit(1);
+                }
+
+                options.cache_dir = optarg;
+                break;
+            case 'm':
+            case 'M':
+                objective_text = optarg;
+                maximize = option == 'M';
+                break;
+            case 'e':
+                radius_text = optarg;
+                break;
+            case 'x':
+                linear_pruning = true;
+                break;
+            case 'l':
+                if (!batch_add(optarg, true, &paths, &path_count)) {
+                    fprintf(stderr, "error reading manifest %s\n", optarg);
+                    exit(1);
+                }
+
+                manifest = true;
+                break;
+            case 's':
+                print_stats = true;
+                break;
+            case 'S':
+                stats_path = optarg;
+                break;
+            case 'T':
+                trace_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (options.thread_max < 1) {
+        usage(argv[0]);
+    }
+
+    if (radius_text && objective_text) {
+        fprintf(stderr, "-e enumerates a ball and takes no objective\n");
+        usage(argv[0]);
+    }
+
+    // the ball search has no LPs to presolve or cut, and prints to stdout
+    if (radius_text && (options.presolve_depth != 0 || options.cut_depth != 0 || results_path)) {
+        fprintf(stderr, "-e takes none of -p, -g and -o\n");
+        usage(argv[0]);
+    }
+
+    if (print_stats || stats_path) {
+#ifdef LATTICE_NUMSTATS
+        numstats_enable();
 #else
-    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+        fprintf(stderr, "numeric statistics need a build with LATTICE_NUMSTATS\n");
+        exit(1);
 #endif
+    }
+
+    if (trace_path) {
+        trace_enable();
+    }
+
+    for (int i = optind; i < argc; ++i) {
+        batch_add(argv[i], false, &paths, &path_count);
+    }
+
+    // a directory expands to its files, so a single argument that came back
+    // unchanged is a single instance
+    if (manifest || argc - optind > 1 || (argc - optind == 1 && (path_count != 1 || strcmp(paths[0], argv[optind]) != 0))) {
+        if (radius_text) {
+            fprintf(stderr, "-e takes a single instance\n");
+            usage(argv[0]);
+        }
+
+        return run_batch(paths, path_count, binary_path, results_path, format, objective_text, maximize, &options, print_stats, stats_path, trace_path, argv[0]);
+    }
+
+    const char* path = optind < argc ? argv[optind] : NULL;
+
+    matrix_t* basis;
+    matrix_t* lower;
+    matrix_t* upper;
+    matrix_t* constraints;
+
+    if (!(path ? parse_file(path, &basis, &lower, &upper, &constraints) : parse_data(stdin, &basis, &lower, &upper, &constraints))) {
+        fprintf(stderr, "error parsing file %s\n", path ? path : "(stdin)");
+        exit(1);
+    }
+
+    if (binary_path) {
+        FILE* stream = fopen(binary_path, "wb");
+
+        if (!stream || !write_binary(stream, basis, lower, upper, constraints) || fclose(stream) != 0) {
+            fprintf(stderr, "error writing file %s\n", binary_path);
+            exit(1);
+        }
+
+        matrix_free(basis);
+        matrix_free(lower);
+        matrix_free(upper);
+
+        if (constraints) {
+            matrix_free(constraints);
+        }
+
+        return 0;
+    }
+
+    if (radius_text && constraints) {
+        fprintf(stderr, "-e enumerates a ball and takes no constraints, but %s has some\n", path ? path : "(stdin)");
+        exit(1);
+    }
+
+    matrix_t* objective = NULL;
+    mpq_t optimum;
+    mpq_init(optimum);
+
+    if (objective_text) {
+        objective = matrix_alloc(1, matrix_rows(basis));
+
+        if (!parse_vector(objective_text, objective)) {
+            fprintf(stderr, "objective must have %ld rational coefficients\n", matrix_rows(basis));
+            exit(1);
+        }
+
+        if (maximize) {
+            matrix_neg(objective, objective);
+        }
+
+        options.objective = objective;
+        options.optimum_out = optimum;
+    }
+
+    FILE* results_stream = stdout;
+
+    if (results_path) {
+        results_stream = fopen(results_path, format == OUTPUT_BINARY ? "wb" : "w");
+
+        if (!results_stream) {
+            fprintf(stderr, "error opening file %s\n", results_path);
+            exit(1);
+        }
+    }
+
+    // keep the summary out of a binary stream on stdout
+    FILE* summary_stream = results_stream == stdout && format == OUTPUT_BINARY ? stderr : stdout;
+
+    long count = 0;
+    output_t* output = output_alloc(results_stream, format, matrix_rows(basis));
 
     struct timespec start;
     struct timespec end;
 
     clock_gettime(CLOCK_MONOTONIC, &start);
-    enumerate(basis, lower, upper, &count, &results, threads);
+
+    if (radius_text) {
+        // the ball around the center of the box, which is otherwise unused
+        long dimensions = matrix_rows(basis);
+        matrix_t* target = matrix_alloc(1, dimensions);
+        matrix_t* pruning = linear_pruning ? sphere_linear_pruning(dimensions) : NULL;
+        mpq_t radius2;
+
+        mpq_init(radius2);
+
+        if (mpq_set_str(radius2, radius_text, 10) != 0) {
+            fprintf(stderr, "invalid squared radius %s\n", radius_text);
+            exit(1);
+        }
+
+        mpq_canonicalize(radius2);
+
+        for (long col = 0; col < dimensions; ++col) {
+            mpq_ptr t = matrix_at(target, 0, col);
+
+            mpq_add(t, matrix_cat(lower, 0, col), matrix_cat(upper, 0, col));
+            mpq_div_2exp(t, t, 1);
+        }
+
+        sphere_enumerate(basis, target, radius2, pruning, &count, NULL, output, NULL, &options);
+
+        mpq_clear(radius2);
+        matrix_free(target);
+
+        if (pruning) {
+            matrix_free(pruning);
+        }
+    } else {
+        enumerate(basis, lower, upper, constraints, &count, NULL, output, NULL, &options);
+    }
+
     clock_gettime(CLOCK_MONOTONIC, &end);
 
+    if (output) {
+        output_free(output);
+    }
+
+    if (results_stream != stdout) {
+        fclose(results_stream);
+    }
+
     long elapsed_h;
     long elapsed_m;
     long elapsed_s;
@@ -123,26 +412,44 @@ int main(int argc, char** argv) {
 
     get_duration(&start, &end, NULL, &elapsed_h, &elapsed_m, &elapsed_s, &elapsed_ms, NULL, NULL);
 
-    for (long i = 0; i < count; ++i) {
-        matrix_print_t(stdout, results[i]);
-        printf("\n");
+    fprintf(summary_stream, "\n");
+    fprintf(summary_stream, "elapsed: %02ld:%02ld:%02ld.%03ld\n", elapsed_h, elapsed_m, elapsed_s, elapsed_ms);
+    fprintf(summary_stream, "count:   %ld\n", count);
+
+    if (objective && count > 0) {
+        if (maximize) {
+            mpq_neg(optimum, optimum);
+        }
+
+        fprintf(summary_stream, "optimum: ");
+        mpq_out_str(summary_stream, 10, optimum);
+        fprintf(summary_stream, "\n");
+    }
+
+    if (objective) {
+        matrix_free(objective);
     }
 
-    printf("\n");
-    printf("elapsed: %02ld:%02ld:%02ld.%03ld\n", elapsed_h, elapsed_m, elapsed_s, elapsed_ms);
-    printf("count:   %ld\n", count);
+    mpq_clear(optimum);
 
     matrix_free(basis);
     matrix_free(lower);
     matrix_free(upper);
 
-    for (long i = 0; i < count; ++i) {
-        matrix_free(results[i]);
+    if (constraints) {
+        matrix_free(constraints);
+    }
+
+    free(cpus);
+
+    for (long i = 0; i < path_count; ++i) {
+        free(paths[i]);
     }
 
-    free(results);
+    free(paths);
 
-    printf("max size: %lu\n", max_size);
+    report_numstats(summary_stream, print_stats, stats_path);
+    write_trace(trace_path);
 
     return 0;
 }
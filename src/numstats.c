@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include <pthread.h>
+
+#include "numstats.h"
+
+// bucket i holds operands of [2^i, 2^(i + 1)) bits
+#define NUMSTATS_BUCKETS 32
+
+typedef struct {
+    unsigned long ops[NUMSTATS_KERNELS][NUMSTATS_OPS];
+    unsigned long bits[NUMSTATS_KERNELS][NUMSTATS_BUCKETS];
+    size_t max_bits;
+} numstats_t;
+
+static const char* const kernel_names[NUMSTATS_KERNELS] = { "other", "lp_solve", "lp_step", "lp_pivot", "matrix_lu", "solve" };
+static const char* const op_names[NUMSTATS_OPS] = { "add", "sub", "mul", "div" };
+
+bool numstats_enabled;
+_Thread_local numstats_kernel_t numstats_kernel = NUMSTATS_OTHER;
+
+static _Thread_local numstats_t* local;
+
+static numstats_t total;
+static pthread_mutex_t total_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t exit_key;
+static pthread_once_t exit_once = PTHREAD_ONCE_INIT;
+
+static void merge(numstats_t* src) {
+    pthread_mutex_lock(&total_mutex);
+
+    for (long kernel = 0; kernel < NUMSTATS_KERNELS; ++kernel) {
+        for (long op = 0; op < NUMSTATS_OPS; ++op) {
+            total.ops[kernel][op] += src->ops[kernel][op];
+        }
+
+        for (long bucket = 0; bucket < NUMSTATS_BUCKETS; ++bucket) {
+            total.bits[kernel][bucket] += src->bits[kernel][bucket];
+        }
+    }
+
+    if (src->max_bits > total.max_bits) {
+        total.max_bits = src->max_bits;
+    }
+
+    pthread_mutex_unlock(&total_mutex);
+
+    memset(src, 0, sizeof(numstats_t));
+}
+
+static void thread_exit(void* data) {
+    merge(data);
+    free(data);
+}
+
+static void create_key(void) {
+    pthread_key_create(&exit_key, thread_exit);
+}
+
+void numstats_enable(void) {
+    pthread_once(&exit_once, create_key);
+    numstats_enabled = true;
+}
+
+static void record_size(numstats_t* stats, mpq_srcptr src) {
+    size_t numerator = mpz_sizeinbase(mpq_numref(src), 2);
+    size_t denominator = mpz_sizeinbase(mpq_denref(src), 2);
+    size_t bits = numerator > denominator ? numerator : denominator;
+    long bucket = 0;
+
+    for (size_t rest = bits; rest > 1 && bucket < NUMSTATS_BUCKETS - 1; rest >>= 1) {
+        ++bucket;
+    }
+
+    stats->bits[numstats_kernel][bucket] += 1;
+
+    if (bits > stats->max_bits) {
+        stats->max_bits = bits;
+    }
+}
+
+void numstats_record(numstats_op_t op, mpq_srcptr b, mpq_srcptr c) {
+    if (!local) {
+        local = calloc(1, sizeof(numstats_t));
+        pthread_setspecific(exit_key, local);
+    }
+
+    local->ops[numstats_kernel][op] += 1;
+    record_size(local, b);
+    record_size(local, c);
+}
+
+void numstats_flush(void) {
+    if (local) {
+        merge(local);
+    }
+}
+
+void numstats_print(FILE* dest) {
+    numstats_flush();
+    pthread_mutex_lock(&total_mutex);
+
+    fprintf(dest, "max operand: %zu bits\n", total.max_bits);
+    fprintf(dest, "%-10s %14s %14s %14s %14s\n", "kernel", op_names[0], op_names[1], op_names[2], op_names[3]);
+
+    for (long kernel = 0; kernel < NUMSTATS_KERNELS; ++kernel) {
+        fprintf(dest, "%-10s", kernel_names[kernel]);
+
+        for (long op = 0; op < NUMSTATS_OPS; ++op) {
+            fprintf(dest, " %14lu", total.ops[kernel][op]);
+        }
+
+        fprintf(dest, "\n");
+    }
+
+    fprintf(dest, "%-10s", "bits");
+
+    for (long kernel = 0; kernel < NUMSTATS_KERNELS; ++kernel) {
+        fprintf(dest, " %10s", kernel_names[kernel]);
+    }
+
+    fprintf(dest, "\n");
+
+    for (long bucket = 0; bucket < NUMSTATS_BUCKETS; ++bucket) {
+        bool used = false;
+
+        for (long kernel = 0; kernel < NUMSTATS_KERNELS; ++kernel) {
+            used = used || total.bits[kernel][bucket] != 0;
+        }
+
+        if (!used) {
+            continue;
+        }
+
+        fprintf(dest, "<%-9lu", 2ul << bucket);
+
+        for (long kernel = 0; kernel < NUMSTATS_KERNELS; ++kernel) {
+            fprintf(dest, " %10lu", total.bits[kernel][bucket]);
+        }
+
+        fprintf(dest, "\n");
+    }
+
+    pthread_mutex_unlock(&total_mutex);
+}
+
+bool numstats_write_json(FILE* dest) {
+    numstats_flush();
+    pthread_mutex_lock(&total_mutex);
+
+    fprintf(dest, "{\n");
+    fprintf(dest, "  \"max_bits\": %zu,\n", total.max_bits);
+    fprintf(dest, "  \"kernels\": [");
+
+    for (long kernel = 0; kernel < NUMSTATS_KERNELS; ++kernel) {
+        fprintf(dest, "%s\n    {", kernel == 0 ? "" : ",");
+        fprintf(dest, " \"name\": \"%s\",", kernel_names[kernel]);
+
+        for (long op = 0; op < NUMSTATS_OPS; ++op) {
+            fprintf(dest, " \"%s\": %lu,", op_names[op], total.ops[kernel][op]);
+        }
+
+        // operands of [bits_below / 2, bits_below) bits
+        fprintf(dest, " \"bits\": [");
+        bool first = true;
+
+        for (long bucket = 0; bucket < NUMSTATS_BUCKETS; ++bucket) {
+            if (total.bits[kernel][bucket] != 0) {
+                fprintf(dest, "%s{ \"bits_below\": %lu, \"count\": %lu }", first ? " " : ", ", 2ul << bucket, total.bits[kernel][bucket]);
+                first = false;
+            }
+        }
+
+        fprintf(dest, " ] }");
+    }
+
+    fprintf(dest, "\n  ]\n}\n");
+
+    pthread_mutex_unlock(&total_mutex);
+
+    return !ferror(dest);
+}
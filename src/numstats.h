@@ -0,0 +1,58 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <gmp.h>
+
+// counts of mpq_add/sub/mul/div per kernel and histograms of their operand
+// sizes, kept per thread and merged when a thread exits or calls
+// numstats_flush(). compiled in with LATTICE_NUMSTATS, and recorded only
+// after numstats_enable(), so a build with it costs one branch per operation.
+
+typedef enum {
+    NUMSTATS_OTHER,
+    NUMSTATS_LP_SOLVE,
+    NUMSTATS_LP_STEP,
+    NUMSTATS_LP_PIVOT,
+    NUMSTATS_MATRIX_LU,
+    NUMSTATS_SOLVE,
+    NUMSTATS_KERNELS,
+} numstats_kernel_t;
+
+typedef enum {
+    NUMSTATS_ADD,
+    NUMSTATS_SUB,
+    NUMSTATS_MUL,
+    NUMSTATS_DIV,
+    NUMSTATS_OPS,
+} numstats_op_t;
+
+extern bool numstats_enabled;
+extern _Thread_local numstats_kernel_t numstats_kernel;
+
+void numstats_enable(void);
+void numstats_record(numstats_op_t op, mpq_srcptr b, mpq_srcptr c);
+void numstats_flush(void);
+
+// merged totals over every thread that has exited or flushed, and the caller
+void numstats_print(FILE* dest);
+bool numstats_write_json(FILE* dest);
+
+#ifdef LATTICE_NUMSTATS
+
+// attributes the operations up to the matching NUMSTATS_LEAVE() to kernel
+#define NUMSTATS_ENTER(kernel) numstats_kernel_t numstats_previous = numstats_kernel; numstats_kernel = (kernel)
+#define NUMSTATS_LEAVE()       numstats_kernel = numstats_previous
+
+#define NUMSTATS_MPQ(op, a, b, c, f) do { \
+                                         if (numstats_enabled) numstats_record(op, b, c); \
+                                         f(a, b, c); \
+                                     } while (0)
+
+#else
+
+#define NUMSTATS_ENTER(kernel) ((void) 0)
+#define NUMSTATS_LEAVE()       ((void) 0)
+
+#endif
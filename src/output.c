@@ -0,0 +1,443 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gmp.h>
+#include <pthread.h>
+
+#include "output.h"
+#include "la.h"
+
+#define OUTPUT_MAGIC "LATR"
+
+#define FLUSH_SIZE   (1 << 16)     // pending bytes that wake the writer
+#define PENDING_MAX  (1 << 26)     // pending bytes that block producers
+#define FLUSH_PERIOD 100000000     // ns between writer wakeups
+
+// producers only copy limbs into the pending buffer; all formatting happens on
+// the writer thread. a record is the number of points after the first in the
+// range it stands for, then the first point's coordinates, each stored as its
+// signed limb count followed by the limbs.
+struct output_s {
+    FILE* dest;
+    output_format_t format;
+    long dimensions;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t ready;
+    pthread_cond_t drained;
+    pthread_t thread;
+    bool threaded;             // false if the writer did not start, and producers format instead
+    bool closing;
+
+    char* pending;
+    size_t pending_size;
+    size_t pending_capacity;
+
+    char* text;
+    size_t text_size;
+    size_t text_capacity;
+};
+
+bool output_parse_format(const char* name, output_format_t* format_out) {
+    if (strcmp(name, "text") == 0) {
+        *format_out = OUTPUT_TEXT;
+    } else if (strcmp(name, "binary") == 0) {
+        *format_out = OUTPUT_BINARY;
+    } else if (strcmp(name, "ranges") == 0) {
+        *format_out = OUTPUT_RANGES;
+    } else if (strcmp(name, "none") == 0) {
+        *format_out = OUTPUT_NONE;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static void text_reserve(output_t* output, size_t size) {
+    if (output->text_size + size > output->text_capacity) {
+        while (output->text_size + size > output->text_capacity) {
+            output->text_capacity *= 2;
+        }
+
+        output->text = realloc(output->text, output->text_capacity);
+    }
+}
+
+static void text_flush(output_t* output) {
+    fwrite(output->text, 1, output->text_size, output->dest);
+    output->text_size = 0;
+}
+
+static void text_byte(output_t* output, char c) {
+    text_reserve(output, 1);
+    output->text[output->text_size++] = c;
+}
+
+static void write_decimal(output_t* output, long size, const mp_limb_t* limbs) {
+    long limb_count = size < 0 ? -size : size;
+
+    if (size < 0) {
+        text_byte(output, '-');
+    }
+
+    if (limb_count == 0) {
+        text_byte(output, '0');
+    } else if (limb_count == 1 && sizeof(mp_limb_t) <= sizeof(unsigned long)) {
+        char digits[24];
+        char* pos = digits + sizeof(digits);
+        unsigned long value = limbs[0];
+
+        do {
+            *--pos = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+
+        text_reserve(output, digits + sizeof(digits) - pos);
+        memcpy(output->text + output->text_size, pos, digits + sizeof(digits) - pos);
+        output->text_size += digits + sizeof(digits) - pos;
+    } else {
+        mpz_t value;
+        mpz_roinit_n(value, limbs, limb_count);
+
+        text_reserve(output, mpz_sizeinbase(value, 10) + 2);
+        mpz_get_str(output->text + output->text_size, 10, value);
+        output->text_size += strlen(output->text + output->text_size);
+    }
+}
+
+static void write_varint(output_t* output, uint64_t value) {
+    text_reserve(output, 10);
+
+    while (value >= 0x80) {
+        output->text[output->text_size++] = (char) (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+
+    output->text[output->text_size++] = (char) value;
+}
+
+// zigzag encoding of an arbitrary precision value, emitted 7 bits at a time
+static void write_zigzag(output_t* output, long size, const mp_limb_t* limbs) {
+    long limb_count = size < 0 ? -size : size;
+
+    if (limb_count == 0) {
+        write_varint(output, 0);
+    } else if (limb_count == 1 && limbs[0] < ((mp_limb_t) 1 << 63)) {
+        write_varint(output, size < 0 ? 2 * (uint64_t) limbs[0] - 1 : 2 * (uint64_t) limbs[0]);
+    } else {
+        mpz_t value;
+        mpz_t zigzag;
+
+        mpz_roinit_n(value, limbs, limb_count);
+        mpz_init(zigzag);
+        mpz_mul_2exp(zigzag, value, 1);
+
+        if (size < 0) {
+            mpz_sub_ui(zigzag, zigzag, 1);
+        }
+
+        size_t bits = mpz_sizeinbase(zigzag, 2);
+        text_reserve(output, bits / 7 + 1);
+
+        for (size_t bit = 0; bit < bits; bit += 7) {
+            unsigned char group = 0;
+
+            for (size_t i = 0; i < 7 && bit + i < bits; ++i) {
+                group |= mpz_tstbit(zigzag, bit + i) << i;
+            }
+
+            output->text[output->text_size++] = group | (bit + 7 < bits ? 0x80 : 0);
+        }
+
+        mpz_clear(zigzag);
+    }
+}
+
+static void write_coordinate(output_t* output, long index, long size, const mp_limb_t* limbs) {
+    if (output->format == OUTPUT_BINARY) {
+        write_zigzag(output, size, limbs);
+    } else {
+        if (index != 0) {
+            text_byte(output, ' ');
+        }
+
+        write_decimal(output, size, limbs);
+    }
+}
+
+static void write_mpz(output_t* output, long index, mpz_srcptr value) {
+    long size = mpz_sgn(value) < 0 ? -(long) mpz_size(value) : (long) mpz_size(value);
+    write_coordinate(output, index, size, mpz_limbs_read(value));
+}
+
+static void format_records(output_t* output, const char* data, size_t size) {
+    const char* end = data + size;
+    long last = output->dimensions - 1;
+
+    char* prefix = NULL;
+    size_t prefix_capacity = 0;
+
+    mpz_t value;
+    mpz_init(value);
+
+    while (data < end) {
+        unsigned long width;
+        memcpy(&width, data, sizeof(width));
+        data += sizeof(width);
+
+        size_t prefix_start = output->text_size;
+
+        for (long i = 0; i < output->dimensions; ++i) {
+            long limb_size;
+            memcpy(&limb_size, data, sizeof(limb_size));
+            data += sizeof(limb_size);
+
+            const mp_limb_t* limbs = (const mp_limb_t*) data;
+            data += (limb_size < 0 ? -limb_size : limb_size) * sizeof(mp_limb_t);
+
+            if (i < last || width == 0) {
+                write_coordinate(output, i, limb_size, limbs);
+                continue;
+            }
+
+            mpz_t first;
+            mpz_roinit_n(first, limbs, limb_size < 0 ? -limb_size : limb_size);
+            mpz_set(value, first);
+
+            if (limb_size < 0) {
+                mpz_neg(value, value);
+            }
+
+            // a range is written as first..last, or expanded point by point
+            if (output->format == OUTPUT_RANGES) {
+                write_mpz(output, i, value);
+                mpz_add_ui(value, value, width);
+                text_byte(output, '.');
+                text_byte(output, '.');
+                write_mpz(output, 0, value);
+                continue;
+            }
+
+            size_t prefix_size = output->text_size - prefix_start;
+
+            if (prefix_size > prefix_capacity) {
+                prefix_capacity = prefix_size;
+                prefix = realloc(prefix, prefix_capacity);
+            }
+
+            memcpy(prefix, output->text + prefix_start, prefix_size);
+
+            for (unsigned long k = 0; k <= width; ++k) {
+                if (k != 0) {
+                    if (output->format != OUTPUT_BINARY) {
+                        text_byte(output, '\n');
+                    }
+
+                    if (output->text_size >= FLUSH_SIZE) {
+                        text_flush(output);
+                    }
+
+                    text_reserve(output, prefix_size);
+                    memcpy(output->text + output->text_size, prefix, prefix_size);
+                    output->text_size += prefix_size;
+                    mpz_add_ui(value, value, 1);
+                }
+
+                write_mpz(output, i, value);
+            }
+        }
+
+        if (output->format != OUTPUT_BINARY) {
+            text_byte(output, '\n');
+        }
+
+        if (output->text_size >= FLUSH_SIZE) {
+            text_flush(output);
+        }
+    }
+
+    mpz_clear(value);
+    free(prefix);
+}
+
+static void* output_thread(void* data) {
+    output_t* output = data;
+
+    char* local = NULL;
+    size_t local_capacity = 0;
+
+    pthread_mutex_lock(&output->mutex);
+
+    for (;;) {
+        while (output->pending_size < FLUSH_SIZE && !output->closing) {
+            struct timespec timeout;
+            clock_gettime(CLOCK_REALTIME, &timeout);
+
+            timeout.tv_nsec += FLUSH_PERIOD;
+
+            if (timeout.tv_nsec >= 1000000000) {
+                timeout.tv_nsec -= 1000000000;
+                timeout.tv_sec += 1;
+            }
+
+            if (pthread_cond_timedwait(&output->ready, &output->mutex, &timeout) != 0 && output->pending_size > 0) {
+                break;
+            }
+        }
+
+        if (output->pending_size == 0 && output->closing) {
+            break;
+        }
+
+        char* swap = local;
+        size_t swap_capacity = local_capacity;
+        size_t size = output->pending_size;
+
+        local = output->pending;
+        local_capacity = output->pending_capacity;
+
+        output->pending = swap;
+        output->pending_capacity = swap_capacity;
+        output->pending_size = 0;
+
+        pthread_cond_broadcast(&output->drained);
+        pthread_mutex_unlock(&output->mutex);
+
+        format_records(output, local, size);
+        text_flush(output);
+        fflush(output->dest);
+
+        pthread_mutex_lock(&output->mutex);
+    }
+
+    pthread_mutex_unlock(&output->mutex);
+
+    free(local);
+
+    return NULL;
+}
+
+output_t* output_alloc(FILE* dest, output_format_t format, long dimensions) {
+    if (format == OUTPUT_NONE) {
+        return NULL;
+    }
+
+    output_t* output = malloc(sizeof(output_t));
+
+    output->dest = dest;
+    output->format = format;
+    output->dimensions = dimensions;
+    output->closing = false;
+
+    output->pending = NULL;
+    output->pending_size = 0;
+    output->pending_capacity = 0;
+
+    output->text_size = 0;
+    output->text_capacity = 2 * FLUSH_SIZE;
+    output->text = malloc(output->text_capacity);
+
+    if (format == OUTPUT_BINARY) {
+        memcpy(output->text, OUTPUT_MAGIC, sizeof(OUTPUT_MAGIC) - 1);
+        output->text_size = sizeof(OUTPUT_MAGIC) - 1;
+        write_varint(output, dimensions);
+    }
+
+    pthread_mutex_init(&output->mutex, NULL);
+    pthread_cond_init(&output->ready, NULL);
+    pthread_cond_init(&output->drained, NULL);
+    output->threaded = pthread_create(&output->thread, NULL, output_thread, output) == 0;
+
+    return output;
+}
+
+void output_point(output_t* output, const matrix_t* point) {
+    output_range(output, point, 0);
+}
+
+void output_range(output_t* output, const matrix_t* point, unsigned long width) {
+    assert(matrix_rows(point) == output->dimensions);
+    assert(matrix_cols(point) == 1);
+
+    size_t size = sizeof(width);
+
+    for (long row = 0; row < output->dimensions; ++row) {
+        assert(mpz_cmp_ui(mpq_denref(matrix_cat(point, row, 0)), 1) == 0);
+        size += sizeof(long) + mpz_size(mpq_numref(matrix_cat(point, row, 0))) * sizeof(mp_limb_t);
+    }
+
+    pthread_mutex_lock(&output->mutex);
+
+    while (output->pending_size >= PENDING_MAX) {
+        pthread_cond_wait(&output->drained, &output->mutex);
+    }
+
+    if (output->pending_size + size > output->pending_capacity) {
+        output->pending_capacity = output->pending_capacity == 0 ? 2 * FLUSH_SIZE : output->pending_capacity;
+
+        while (output->pending_size + size > output->pending_capacity) {
+            output->pending_capacity *= 2;
+        }
+
+        output->pending = realloc(output->pending, output->pending_capacity);
+    }
+
+    char* pos = output->pending + output->pending_size;
+
+    memcpy(pos, &width, sizeof(width));
+    pos += sizeof(width);
+
+    for (long row = 0; row < output->dimensions; ++row) {
+        mpz_srcptr value = mpq_numref(matrix_cat(point, row, 0));
+        long limb_size = mpz_sgn(value) < 0 ? -(long) mpz_size(value) : (long) mpz_size(value);
+
+        memcpy(pos, &limb_size, sizeof(limb_size));
+        pos += sizeof(limb_size);
+
+        memcpy(pos, mpz_limbs_read(value), mpz_size(value) * sizeof(mp_limb_t));
+        pos += mpz_size(value) * sizeof(mp_limb_t);
+    }
+
+    output->pending_size += size;
+
+    if (output->pending_size >= FLUSH_SIZE && output->threaded) {
+        pthread_cond_signal(&output->ready);
+    } else if (output->pending_size >= FLUSH_SIZE) {
+        format_records(output, output->pending, output->pending_size);
+        output->pending_size = 0;
+        text_flush(output);
+    }
+
+    pthread_mutex_unlock(&output->mutex);
+}
+
+void output_free(output_t* output) {
+    if (output->threaded) {
+        pthread_mutex_lock(&output->mutex);
+        output->closing = true;
+        pthread_cond_signal(&output->ready);
+        pthread_mutex_unlock(&output->mutex);
+
+        pthread_join(output->thread, NULL);
+    } else {
+        format_records(output, output->pending, output->pending_size);
+    }
+
+    text_flush(output);
+    fflush(output->dest);
+
+    pthread_mutex_destroy(&output->mutex);
+    pthread_cond_destroy(&output->ready);
+    pthread_cond_destroy(&output->drained);
+
+    free(output->pending);
+    free(output->text);
+    free(output);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <gmp.h>
+
+#include "la.h"
+
+typedef enum {
+    OUTPUT_TEXT,   // one point per line, decimal integers separated by spaces
+    OUTPUT_BINARY, // "LATR", varint dimensions, then zigzag varints per coordinate
+    OUTPUT_RANGES, // as text, but a run along the last coordinate is one line ending in first..last
+    OUTPUT_NONE,   // count only
+} output_format_t;
+
+typedef struct output_s output_t;
+
+bool output_parse_format(const char* name, output_format_t* format_out);
+
+output_t* output_alloc(FILE* dest, output_format_t format, long dimensions);
+void output_point(output_t* output, const matrix_t* point);
+
+// point and the width points after it along the last coordinate, as one
+// record that the writer expands unless the format is OUTPUT_RANGES
+void output_range(output_t* output, const matrix_t* point, unsigned long width);
+void output_free(output_t* output);
@@ -1,117 +1,591 @@
 #define _POSIX_C_SOURCE 200809L
 
-#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <gmp.h>
 
 #include "parse.h"
 #include "la.h"
 
-#define error_if(__x)      do { if (__x) { free(line); return false; } } while (false)
-#define get_line()         error_if(getline(&line, &n, stream) == -1)
-#define get_long(__x, __s) do { __x = strtol(__s, &end, 10); error_if(__s == end); } while (false)
+#define BINARY_MAGIC   "LATB"
+#define BINARY_VERSION 2
+
+// 10^19 is the largest power of ten that fits in an unsigned long
+#define DIGITS_PER_CHUNK 19
+
+typedef struct {
+    const char* pos;
+    const char* end;
+} cursor_t;
+
+// binary header, followed by dimensions * (dimensions + 2) entries, then (from
+// version 2) an int64_t constraint count and constraints * (dimensions + 1)
+// entries. each entry is a signed limb count for the numerator (the sign is
+// the sign of the value), an unsigned limb count for the denominator (0
+// meaning 1) and the limbs themselves, least significant first.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t limb_bits;
+    uint32_t reserved;
+    int64_t dimensions;
+} binary_header_t;
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
 
-static bool parse_row(FILE *stream, matrix_t* dest, long row) {
-    char *line = NULL;
-    char *end = NULL;
-    size_t n = 0;
+static bool next_token(cursor_t* cursor, const char** token_out, size_t* length_out) {
+    const char* pos = cursor->pos;
 
-    get_line();
-    char *pos = line;
+    while (pos < cursor->end && is_space(*pos)) ++pos;
 
-    for (long col = 0; col < matrix_cols(dest); ++col) {
-        char *pos_end = pos;
-        char space;
+    const char* token = pos;
+
+    while (pos < cursor->end && !is_space(*pos)) ++pos;
+
+    cursor->pos = pos;
+    *token_out = token;
+    *length_out = pos - token;
+
+    return pos != token;
+}
+
+static bool at_end(cursor_t* cursor) {
+    const char* token;
+    size_t length;
+
+    return !next_token(cursor, &token, &length);
+}
+
+// digits are folded in DIGITS_PER_CHUNK at a time, so short values never touch
+// more than a single limb and nothing is copied out of the mapped input.
+static bool parse_natural(mpz_ptr dest, const char* digits, size_t length) {
+    if (length == 0) {
+        return false;
+    }
+
+    bool first = true;
+
+    while (length > 0) {
+        size_t chunk = length % DIGITS_PER_CHUNK == 0 ? DIGITS_PER_CHUNK : length % DIGITS_PER_CHUNK;
+        unsigned long value = 0;
+        unsigned long scale = 1;
+
+        for (size_t i = 0; i < chunk; ++i) {
+            if (digits[i] < '0' || digits[i] > '9') {
+                return false;
+            }
+
+            value = value * 10 + (digits[i] - '0');
+            scale *= 10;
+        }
+
+        if (first) {
+            mpz_set_ui(dest, value);
+            first = false;
+        } else {
+            mpz_mul_ui(dest, dest, scale);
+            mpz_add_ui(dest, dest, value);
+        }
+
+        digits += chunk;
+        length -= chunk;
+    }
+
+    return true;
+}
+
+static bool parse_rational(cursor_t* cursor, mpq_ptr dest) {
+    const char* token;
+    size_t length;
+
+    if (!next_token(cursor, &token, &length)) {
+        return false;
+    }
+
+    bool negative = false;
 
-        while (*pos_end && isspace(*pos_end)) ++pos_end;
-        while (*pos_end && !isspace(*pos_end)) ++pos_end;
+    if (*token == '-' || *token == '+') {
+        negative = *token == '-';
+        ++token;
+        --length;
+    }
 
-        space = *pos_end;
-        *pos_end = 0;
+    const char* slash = memchr(token, '/', length);
+    size_t numerator_length = slash ? (size_t) (slash - token) : length;
 
-        error_if(mpq_set_str(matrix_at(dest, row, col), pos, 10));
-        mpq_canonicalize(matrix_at(dest, row, col));
+    if (!parse_natural(mpq_numref(dest), token, numerator_length)) {
+        return false;
+    }
 
-        *pos_end = space;
-        pos = pos_end;
+    if (negative) {
+        mpz_neg(mpq_numref(dest), mpq_numref(dest));
     }
 
-    char *line_end = pos;
-    while(*line_end && isspace(*line_end)) ++line_end;
+    if (slash) {
+        if (!parse_natural(mpq_denref(dest), slash + 1, length - numerator_length - 1) || mpz_sgn(mpq_denref(dest)) == 0) {
+            return false;
+        }
 
-    error_if(*line_end);
-    free(line);
+        mpq_canonicalize(dest);
+    } else {
+        mpz_set_ui(mpq_denref(dest), 1);
+    }
 
     return true;
 }
 
-static bool parse_basis(FILE *stream, matrix_t* dest) {
-    char *line = NULL;
-    char *end = NULL;
-    size_t n = 0;
+// a constraint row is dimensions coefficients, "<=" or ">=", and the bound.
+// rows are stored as a y <= b, so ">=" rows are negated.
+static bool parse_constraint(cursor_t* cursor, matrix_t* constraints, long row) {
+    const char* token;
+    size_t length;
+    long dimensions = matrix_cols(constraints) - 1;
+
+    for (long col = 0; col < dimensions; ++col) {
+        if (!parse_rational(cursor, matrix_at(constraints, row, col))) {
+            return false;
+        }
+    }
 
-    get_line();
+    if (!next_token(cursor, &token, &length) || length != 2 || (memcmp(token, "<=", 2) != 0 && memcmp(token, ">=", 2) != 0)) {
+        return false;
+    }
 
-    for (long row = 0; row < matrix_rows(dest); ++row) {
-        error_if(!parse_row(stream, dest, row));
+    if (!parse_rational(cursor, matrix_at(constraints, row, dimensions))) {
+        return false;
     }
 
-    free(line);
+    if (*token == '>') {
+        for (long col = 0; col <= dimensions; ++col) {
+            mpq_neg(matrix_at(constraints, row, col), matrix_at(constraints, row, col));
+        }
+    }
 
     return true;
 }
 
-static bool parse_bounds(FILE *stream, matrix_t* lower, matrix_t* upper) {
-    char *line = NULL;
-    char *end = NULL;
-    size_t n = 0;
+static bool parse_text(cursor_t* cursor, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out) {
+    const char* token;
+    size_t length;
+    long dimensions = 0;
+
+    if (!next_token(cursor, &token, &length)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; ++i) {
+        if (token[i] < '0' || token[i] > '9' || dimensions > LONG_MAX / 10 - 1) {
+            return false;
+        }
+
+        dimensions = dimensions * 10 + (token[i] - '0');
+    }
+
+    if (dimensions < 1) {
+        return false;
+    }
+
+    // the basis and both corners hold dimensions * (dimensions + 2) tokens,
+    // and every token but the last takes a separator after it, which bounds
+    // the allocation
+    size_t tokens_left = (size_t) (cursor->end - cursor->pos + 1) / 2;
+
+    if ((size_t) dimensions > tokens_left || (size_t) dimensions + 2 > tokens_left / (size_t) dimensions) {
+        return false;
+    }
+
+    matrix_t* basis = matrix_alloc(dimensions, dimensions);
+    matrix_t* lower = matrix_alloc(1, dimensions);
+    matrix_t* upper = matrix_alloc(1, dimensions);
+    bool success = true;
+
+    for (long row = 0; success && row < dimensions; ++row) {
+        for (long col = 0; success && col < dimensions; ++col) {
+            success = parse_rational(cursor, matrix_at(basis, row, col));
+        }
+    }
+
+    for (long col = 0; success && col < dimensions; ++col) {
+        success = parse_rational(cursor, matrix_at(lower, 0, col));
+    }
+
+    for (long col = 0; success && col < dimensions; ++col) {
+        success = parse_rational(cursor, matrix_at(upper, 0, col));
+    }
+
+    // every remaining token belongs to a constraint row
+    cursor_t rest = *cursor;
+    long tokens = 0;
+
+    while (success && !at_end(&rest)) {
+        ++tokens;
+    }
+
+    matrix_t* constraints = NULL;
+    long constraint_count = tokens / (dimensions + 2);
+
+    if (success && tokens % (dimensions + 2) != 0) {
+        success = false;
+    } else if (success && constraint_count > 0) {
+        constraints = matrix_alloc(constraint_count, dimensions + 1);
+
+        for (long row = 0; success && row < constraint_count; ++row) {
+            success = parse_constraint(cursor, constraints, row);
+        }
+    }
+
+    if (!success) {
+        matrix_free(basis);
+        matrix_free(lower);
+        matrix_free(upper);
+
+        if (constraints) {
+            matrix_free(constraints);
+        }
+
+        return false;
+    }
+
+    *basis_out = basis;
+    *lower_out = lower;
+    *upper_out = upper;
+    *constraints_out = constraints;
+
+    return true;
+}
+
+bool parse_vector(const char* text, matrix_t* dest) {
+    cursor_t cursor = { text, text + strlen(text) };
+
+    for (long col = 0; col < matrix_cols(dest); ++col) {
+        if (!parse_rational(&cursor, matrix_at(dest, 0, col))) {
+            return false;
+        }
+    }
+
+    return at_end(&cursor);
+}
+
+static bool read_bytes(cursor_t* cursor, void* dest, size_t size) {
+    if ((size_t) (cursor->end - cursor->pos) < size) {
+        return false;
+    }
+
+    memcpy(dest, cursor->pos, size);
+    cursor->pos += size;
+
+    return true;
+}
+
+static bool read_limbs(cursor_t* cursor, mpz_ptr dest, size_t limbs) {
+    if (limbs == 0) {
+        mpz_set_ui(dest, 0);
+        return true;
+    }
+
+    if ((size_t) (cursor->end - cursor->pos) / sizeof(mp_limb_t) < limbs) {
+        return false;
+    }
+
+    mp_limb_t* data = mpz_limbs_write(dest, limbs);
+    memcpy(data, cursor->pos, limbs * sizeof(mp_limb_t));
+    cursor->pos += limbs * sizeof(mp_limb_t);
+
+    // drop high zero limbs so hand-written files still load canonically
+    while (limbs > 0 && data[limbs - 1] == 0) --limbs;
+
+    mpz_limbs_finish(dest, limbs);
+
+    return true;
+}
+
+static bool read_rational(cursor_t* cursor, mpq_ptr dest) {
+    int64_t numerator_size;
+    uint64_t denominator_size;
+
+    if (!read_bytes(cursor, &numerator_size, sizeof(numerator_size)) || !read_bytes(cursor, &denominator_size, sizeof(denominator_size))) {
+        return false;
+    }
+
+    // its negation would overflow
+    if (numerator_size == INT64_MIN) {
+        return false;
+    }
+
+    if (!read_limbs(cursor, mpq_numref(dest), numerator_size < 0 ? -numerator_size : numerator_size)) {
+        return false;
+    }
+
+    if (numerator_size < 0) {
+        mpz_neg(mpq_numref(dest), mpq_numref(dest));
+    }
+
+    if (denominator_size == 0) {
+        mpz_set_ui(mpq_denref(dest), 1);
+        return true;
+    }
+
+    if (!read_limbs(cursor, mpq_denref(dest), denominator_size) || mpz_sgn(mpq_denref(dest)) == 0) {
+        return false;
+    }
+
+    mpq_canonicalize(dest);
+
+    return true;
+}
 
-    get_line();
+bool read_binary_rational(const char** pos, const char* end, mpq_ptr dest) {
+    cursor_t cursor = { *pos, end };
 
-    error_if(!parse_row(stream, lower, 0));
-    error_if(!parse_row(stream, upper, 0));
+    if (!read_rational(&cursor, dest)) {
+        return false;
+    }
 
-    free(line);
+    *pos = cursor.pos;
 
     return true;
 }
 
-bool parse_data(FILE* stream, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out) {
-    char *line = NULL;
-    char *end = NULL;
-    size_t n = 0;
+static bool parse_binary(cursor_t* cursor, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out) {
+    binary_header_t header;
+
+    if (!read_bytes(cursor, &header, sizeof(header))) {
+        return false;
+    }
+
+    if (header.version < 1 || header.version > BINARY_VERSION || header.limb_bits != 8 * sizeof(mp_limb_t) || header.dimensions < 1) {
+        return false;
+    }
+
+    // the basis and both corners hold dimensions * (dimensions + 2) entries of
+    // at least their two sizes each, which bounds the allocation
+    size_t entries = (size_t) (cursor->end - cursor->pos) / (2 * sizeof(int64_t));
+
+    if ((uint64_t) header.dimensions > entries || (size_t) header.dimensions + 2 > entries / (size_t) header.dimensions) {
+        return false;
+    }
+
+    long dimensions = header.dimensions;
+
+    matrix_t* basis = matrix_alloc(dimensions, dimensions);
+    matrix_t* lower = matrix_alloc(1, dimensions);
+    matrix_t* upper = matrix_alloc(1, dimensions);
+    bool success = true;
+
+    for (long row = 0; success && row < dimensions; ++row) {
+        for (long col = 0; success && col < dimensions; ++col) {
+            success = read_rational(cursor, matrix_at(basis, row, col));
+        }
+    }
+
+    for (long col = 0; success && col < dimensions; ++col) {
+        success = read_rational(cursor, matrix_at(lower, 0, col));
+    }
+
+    for (long col = 0; success && col < dimensions; ++col) {
+        success = read_rational(cursor, matrix_at(upper, 0, col));
+    }
 
-    long dimensions;
+    matrix_t* constraints = NULL;
+    int64_t constraint_count = 0;
 
-    get_line();
-    get_long(dimensions, line);
+    if (success && header.version >= 2) {
+        success = read_bytes(cursor, &constraint_count, sizeof(constraint_count)) && constraint_count >= 0;
 
-    error_if(dimensions < 1);
+        // every entry takes at least its two sizes, which bounds the allocation
+        success = success && (size_t) constraint_count <= (size_t) (cursor->end - cursor->pos) / (2 * sizeof(int64_t) * (dimensions + 1));
+    }
 
-    *basis_out = matrix_alloc(dimensions, dimensions);
-    *lower_out = matrix_alloc(1, dimensions);
-    *upper_out = matrix_alloc(1, dimensions);
+    if (success && constraint_count > 0) {
+        constraints = matrix_alloc(constraint_count, dimensions + 1);
 
-    if (!parse_basis(stream, *basis_out) || !parse_bounds(stream, *lower_out, *upper_out)) {
-        matrix_free(*basis_out);
-        matrix_free(*lower_out);
-        matrix_free(*upper_out);
+        for (long row = 0; success && row < constraint_count; ++row) {
+            for (long col = 0; success && col <= dimensions; ++col) {
+                success = read_rational(cursor, matrix_at(constraints, row, col));
+            }
+        }
+    }
 
-        free(*basis_out);
-        free(*lower_out);
-        free(*upper_out);
+    if (!success || cursor->pos != cursor->end) {
+        matrix_free(basis);
+        matrix_free(lower);
+        matrix_free(upper);
 
-        *basis_out = NULL;
-        *lower_out = NULL;
-        *upper_out = NULL;
+        if (constraints) {
+            matrix_free(constraints);
+        }
 
-        error_if(true);
+        return false;
     }
 
-    free(line);
+    *basis_out = basis;
+    *lower_out = lower;
+    *upper_out = upper;
+    *constraints_out = constraints;
 
     return true;
 }
+
+bool parse_buffer(const char* data, size_t size, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out) {
+    cursor_t cursor = { data, data + size };
+
+    if (size >= sizeof(BINARY_MAGIC) - 1 && memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC) - 1) == 0) {
+        return parse_binary(&cursor, basis_out, lower_out, upper_out, constraints_out);
+    }
+
+    return parse_text(&cursor, basis_out, lower_out, upper_out, constraints_out);
+}
+
+bool parse_data(FILE* stream, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out) {
+    size_t size = 0;
+    size_t capacity = 1 << 16;
+    char* data = malloc(capacity);
+
+    for (;;) {
+        size += fread(data + size, 1, capacity - size, stream);
+
+        if (size < capacity) {
+            break;
+        }
+
+        capacity *= 2;
+        data = realloc(data, capacity);
+    }
+
+    bool success = !ferror(stream) && parse_buffer(data, size, basis_out, lower_out, upper_out, constraints_out);
+    free(data);
+
+    return success;
+}
+
+bool parse_file(const char* path, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    posix_madvise(data, info.st_size, POSIX_MADV_SEQUENTIAL);
+
+    bool success = parse_buffer(data, info.st_size, basis_out, lower_out, upper_out, constraints_out);
+    munmap(data, info.st_size);
+
+    return success;
+}
+
+static void write_limbs(FILE* stream, mpz_srcptr src) {
+    fwrite(mpz_limbs_read(src), sizeof(mp_limb_t), mpz_size(src), stream);
+}
+
+void write_binary_rational(FILE* stream, mpq_srcptr src) {
+    bool integer = mpz_cmp_ui(mpq_denref(src), 1) == 0;
+    int64_t numerator_size = mpz_sgn(mpq_numref(src)) < 0 ? -(int64_t) mpz_size(mpq_numref(src)) : (int64_t) mpz_size(mpq_numref(src));
+    uint64_t denominator_size = integer ? 0 : mpz_size(mpq_denref(src));
+
+    fwrite(&numerator_size, sizeof(numerator_size), 1, stream);
+    fwrite(&denominator_size, sizeof(denominator_size), 1, stream);
+    write_limbs(stream, mpq_numref(src));
+
+    if (!integer) {
+        write_limbs(stream, mpq_denref(src));
+    }
+}
+
+bool write_binary(FILE* stream, const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints) {
+    long dimensions = matrix_rows(basis);
+    binary_header_t header = { BINARY_MAGIC, BINARY_VERSION, 8 * sizeof(mp_limb_t), 0, dimensions };
+
+    fwrite(&header, sizeof(header), 1, stream);
+
+    for (long row = 0; row < dimensions; ++row) {
+        for (long col = 0; col < dimensions; ++col) {
+            write_binary_rational(stream, matrix_cat(basis, row, col));
+        }
+    }
+
+    for (long col = 0; col < dimensions; ++col) {
+        write_binary_rational(stream, matrix_cat(lower, 0, col));
+    }
+
+    for (long col = 0; col < dimensions; ++col) {
+        write_binary_rational(stream, matrix_cat(upper, 0, col));
+    }
+
+    int64_t constraint_count = constraints ? matrix_rows(constraints) : 0;
+    fwrite(&constraint_count, sizeof(constraint_count), 1, stream);
+
+    for (long row = 0; row < constraint_count; ++row) {
+        for (long col = 0; col <= dimensions; ++col) {
+            write_binary_rational(stream, matrix_cat(constraints, row, col));
+        }
+    }
+
+    return !ferror(stream);
+}
+
+static void write_row(FILE* stream, const matrix_t* src, long row) {
+    for (long col = 0; col < matrix_cols(src); ++col) {
+        if (col != 0) {
+            fprintf(stream, " ");
+        }
+
+        mpq_out_str(stream, 10, matrix_cat(src, row, col));
+    }
+
+    fprintf(stream, "\n");
+}
+
+bool write_text(FILE* stream, const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints) {
+    fprintf(stream, "%ld\n\n", matrix_rows(basis));
+
+    for (long row = 0; row < matrix_rows(basis); ++row) {
+        write_row(stream, basis, row);
+    }
+
+    fprintf(stream, "\n");
+    write_row(stream, lower, 0);
+    write_row(stream, upper, 0);
+
+    if (constraints) {
+        long dimensions = matrix_rows(basis);
+
+        fprintf(stream, "\n");
+
+        for (long row = 0; row < matrix_rows(constraints); ++row) {
+            for (long col = 0; col < dimensions; ++col) {
+                mpq_out_str(stream, 10, matrix_cat(constraints, row, col));
+                fprintf(stream, " ");
+            }
+
+            fprintf(stream, "<= ");
+            mpq_out_str(stream, 10, matrix_cat(constraints, row, dimensions));
+            fprintf(stream, "\n");
+        }
+    }
+
+    return !ferror(stream);
+}
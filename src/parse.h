@@ -5,4 +5,16 @@
 
 #include "la.h"
 
-bool parse_data(FILE* stream, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out);
+// constraints_out is set to mpq_t[constraints][dimensions + 1], rows a y <= b
+// with b in the last column, or NULL if the input has none.
+bool parse_buffer(const char* data, size_t size, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out);
+bool parse_data(FILE* stream, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out);
+bool parse_file(const char* path, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out, matrix_t** constraints_out);
+bool parse_vector(const char* text, matrix_t* dest);
+
+bool write_binary(FILE* stream, const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints);
+bool write_text(FILE* stream, const matrix_t* basis, const matrix_t* lower, const matrix_t* upper, const matrix_t* constraints);
+
+// one rational in the binary format's encoding, for other files built from it
+bool read_binary_rational(const char** pos, const char* end, mpq_ptr dest);
+void write_binary_rational(FILE* stream, mpq_srcptr src);
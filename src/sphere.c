@@ -0,0 +1,464 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include <pthread.h>
+
+#include "affinity.h"
+#include "sphere.h"
+
+// prefixes are split off until there are this many per worker
+#define SPHERE_PREFIXES_PER_WORKER 16
+
+typedef struct {
+    long dimensions;
+    mpq_t* mu;                 // mpq_t[dimensions][dimensions], <b_i, b*_j> / |b*_j|^2 at i * dimensions + j, j < i
+    mpq_t* norms;              // mpq_t[dimensions], |b*_i|^2
+    mpq_t* tau;                // mpq_t[dimensions], target in the gram-schmidt basis
+    mpq_t* bounds;             // mpq_t[dimensions], largest projected distance once level i is fixed
+
+    // coefficients at levels >= split are fixed in each prefix, and the
+    // workers claim the prefixes in order
+    matrix_t** prefixes;
+    long prefix_count;
+    long split;
+    long next;
+
+    pthread_mutex_t mutex;
+    long count;
+    long nodes;
+    matrix_t*** results_out;
+    long results_count;
+    output_t* output;
+    const long* cpus;
+    long cpu_count;
+} sphere_t;
+
+typedef struct {
+    sphere_t* sphere;
+    long slot;
+
+    matrix_t* point;           // mpq_t[dimensions][1], the coefficients fixed so far
+    mpq_t* centers;            // mpq_t[dimensions], where the projection puts each level
+    mpq_t* partials;           // mpq_t[dimensions + 1], projected distance with levels >= i fixed
+
+    // while splitting, nodes at level stop are collected as prefixes
+    // instead of searched
+    bool collect;
+    matrix_t** collected;
+    long collected_count;
+
+    long count;
+    long nodes;
+
+    mpq_t candidate;
+    mpq_t t0;
+} sphere_worker_t;
+
+static mpq_t* mpq_array(long count) {
+    mpq_t* array = malloc(count * sizeof(mpq_t));
+
+    for (long i = 0; i < count; ++i) {
+        mpq_init(array[i]);
+    }
+
+    return array;
+}
+
+static void mpq_array_free(mpq_t* array, long count) {
+    for (long i = 0; i < count; ++i) {
+        mpq_clear(array[i]);
+    }
+
+    free(array);
+}
+
+// mu and the squared norms of b*_i = b_i - sum_{j < i} mu_ij b*_j, and the
+// target as sum tau_i b*_i, which is exact since the basis has full rank
+static void sphere_orthogonalize(sphere_t* sphere, const matrix_t* basis, const matrix_t* target) {
+    long dimensions = sphere->dimensions;
+    matrix_t* star = matrix_dup(basis);
+
+    mpq_t t0;
+    mpq_init(t0);
+
+    for (long i = 0; i < dimensions; ++i) {
+        for (long j = 0; j < i; ++j) {
+            mpq_ptr mu = sphere->mu[i * dimensions + j];
+            mpq_set_ui(mu, 0, 1);
+
+            for (long col = 0; col < dimensions; ++col) {
+                mpq_mul(t0, matrix_cat(basis, i, col), matrix_cat(star, j, col));
+                mpq_add(mu, mu, t0);
+            }
+
+            mpq_div(mu, mu, sphere->norms[j]);
+
+            for (long col = 0; col < dimensions; ++col) {
+                mpq_mul(t0, mu, matrix_cat(star, j, col));
+                mpq_sub(matrix_at(star, i, col), matrix_cat(star, i, col), t0);
+            }
+        }
+
+        mpq_set_ui(sphere->norms[i], 0, 1);
+
+        for (long col = 0; col < dimensions; ++col) {
+            mpq_mul(t0, matrix_cat(star, i, col), matrix_cat(star, i, col));
+            mpq_add(sphere->norms[i], sphere->norms[i], t0);
+        }
+
+        mpq_set_ui(sphere->tau[i], 0, 1);
+
+        for (long col = 0; target && col < dimensions; ++col) {
+            mpq_mul(t0, matrix_cat(target, 0, col), matrix_cat(star, i, col));
+            mpq_add(sphere->tau[i], sphere->tau[i], t0);
+        }
+
+        mpq_div(sphere->tau[i], sphere->tau[i], sphere->norms[i]);
+    }
+
+    mpq_clear(t0);
+    matrix_free(star);
+}
+
+// center_level = tau_level - sum_{j > level} mu_j,level c_j
+static void sphere_center(sphere_worker_t* worker, long level) {
+    const sphere_t* sphere = worker->sphere;
+    mpq_ptr center = worker->centers[level];
+
+    mpq_set(center, sphere->tau[level]);
+
+    for (long j = level + 1; j < sphere->dimensions; ++j) {
+        mpq_mul(worker->t0, sphere->mu[j * sphere->dimensions + level], matrix_cat(worker->point, j, 0));
+        mpq_sub(center, center, worker->t0);
+    }
+}
+
+static void sphere_leaf(sphere_worker_t* worker) {
+    sphere_t* sphere = worker->sphere;
+
+    worker->count += 1;
+
+    if (sphere->output) {
+        output_point(sphere->output, worker->point);
+    }
+
+    if (sphere->results_out) {
+        matrix_t* result = matrix_dup(worker->point);
+
+        pthread_mutex_lock(&sphere->mutex);
+
+        *sphere->results_out = realloc(*sphere->results_out, (sphere->results_count + 1) * sizeof(matrix_t*));
+        (*sphere->results_out)[sphere->results_count] = result;
+        sphere->results_count += 1;
+
+        pthread_mutex_unlock(&sphere->mutex);
+    }
+}
+
+static void sphere_walk(sphere_worker_t* worker, long level, long stop);
+
+// fixes level at the candidate and goes on below it, unless the projected
+// distance exceeds the bound
+static bool sphere_try(sphere_worker_t* worker, long level, long stop) {
+    const sphere_t* sphere = worker->sphere;
+    mpq_ptr partial = worker->partials[level];
+
+    mpq_sub(worker->t0, worker->candidate, worker->centers[level]);
+    mpq_mul(worker->t0, worker->t0, worker->t0);
+    mpq_mul(worker->t0, worker->t0, sphere->norms[level]);
+    mpq_add(partial, worker->partials[level + 1], worker->t0);
+
+    if (mpq_cmp(partial, sphere->bounds[level]) > 0) {
+        return false;
+    }
+
+    worker->nodes += 1;
+    mpq_set(matrix_at(worker->point, level, 0), worker->candidate);
+
+    if (level == stop && worker->collect) {
+        worker->collected = realloc(worker->collected, (worker->collected_count + 1) * sizeof(matrix_t*));
+        worker->collected[worker->collected_count++] = matrix_dup(worker->point);
+    } else if (level == 0) {
+        sphere_leaf(worker);
+    } else {
+        sphere_center(worker, level - 1);
+        sphere_walk(worker, level - 1, stop);
+    }
+
+    return true;
+}
+
+// schnorr-euchner order: the integer nearest the center, then alternately
+// one step further out on its side and on the other. the distance grows
+// along each side, so a side ends at its first miss.
+static void sphere_walk(sphere_worker_t* worker, long level, long stop) {
+    mpq_srcptr center = worker->centers[level];
+
+    mpz_t nearest;
+    mpz_init(nearest);
+
+    // floor(center + 1/2)
+    mpz_mul_2exp(nearest, mpq_numref(center), 1);
+    mpz_add(nearest, nearest, mpq_denref(center));
+    mpz_fdiv_q(nearest, nearest, mpq_denref(center));
+    mpz_fdiv_q_2exp(nearest, nearest, 1);
+
+    mpq_set_z(worker->candidate, nearest);
+    long side = mpq_cmp(center, worker->candidate) >= 0 ? 1 : -1;
+
+    if (sphere_try(worker, level, stop)) {
+        bool near = true;
+        bool far = true;
+
+        for (long step = 1; near || far; ++step) {
+            if (near) {
+                mpz_set_si(mpq_numref(worker->candidate), side * step);
+                mpz_set_ui(mpq_denref(worker->candidate), 1);
+                mpz_add(mpq_numref(worker->candidate), mpq_numref(worker->candidate), nearest);
+                near = sphere_try(worker, level, stop);
+            }
+
+            if (far) {
+                mpz_set_si(mpq_numref(worker->candidate), -side * step);
+                mpz_set_ui(mpq_denref(worker->candidate), 1);
+                mpz_add(mpq_numref(worker->candidate), mpq_numref(worker->candidate), nearest);
+                far = sphere_try(worker, level, stop);
+            }
+        }
+    }
+
+    mpz_clear(nearest);
+}
+
+// fixes the levels >= split from prefix, then visits the levels below it
+// down to stop
+static void sphere_resume(sphere_worker_t* worker, const matrix_t* prefix, long split, long stop) {
+    long dimensions = worker->sphere->dimensions;
+
+    for (long level = dimensions - 1; level >= split; --level) {
+        mpq_set(matrix_at(worker->point, level, 0), matrix_cat(prefix, level, 0));
+        sphere_center(worker, level);
+
+        mpq_sub(worker->t0, matrix_cat(prefix, level, 0), worker->centers[level]);
+        mpq_mul(worker->t0, worker->t0, worker->t0);
+        mpq_mul(worker->t0, worker->t0, worker->sphere->norms[level]);
+        mpq_add(worker->partials[level], worker->partials[level + 1], worker->t0);
+    }
+
+    if (split == 0) {
+        sphere_leaf(worker);
+    } else {
+        sphere_center(worker, split - 1);
+        sphere_walk(worker, split - 1, stop);
+    }
+}
+
+static void sphere_worker_init(sphere_worker_t* worker, sphere_t* sphere, long slot) {
+    long dimensions = sphere->dimensions;
+
+    worker->sphere = sphere;
+    worker->slot = slot;
+    worker->point = matrix_alloc(dimensions, 1);
+    worker->centers = mpq_array(dimensions);
+    worker->partials = mpq_array(dimensions + 1);
+    worker->collect = false;
+    worker->collected = NULL;
+    worker->collected_count = 0;
+    worker->count = 0;
+    worker->nodes = 0;
+
+    mpq_init(worker->candidate);
+    mpq_init(worker->t0);
+}
+
+static void sphere_worker_free(sphere_worker_t* worker) {
+    long dimensions = worker->sphere->dimensions;
+
+    matrix_free(worker->point);
+    mpq_array_free(worker->centers, dimensions);
+    mpq_array_free(worker->partials, dimensions + 1);
+    mpq_clear(worker->candidate);
+    mpq_clear(worker->t0);
+}
+
+// claims prefixes until none are left, then merges the worker's totals
+static void sphere_drain(sphere_worker_t* worker) {
+    sphere_t* sphere = worker->sphere;
+
+    for (;;) {
+        pthread_mutex_lock(&sphere->mutex);
+        long index = sphere->next++;
+        pthread_mutex_unlock(&sphere->mutex);
+
+        if (index >= sphere->prefix_count) {
+            break;
+        }
+
+        sphere_resume(worker, sphere->prefixes[index], sphere->split, 0);
+    }
+
+    pthread_mutex_lock(&sphere->mutex);
+    sphere->count += worker->count;
+    sphere->nodes += worker->nodes;
+    pthread_mutex_unlock(&sphere->mutex);
+}
+
+static void* sphere_thread(void* data) {
+    sphere_worker_t* worker = data;
+    sphere_t* sphere = worker->sphere;
+
+    if (sphere->cpus) {
+        affinity_pin(sphere->cpus[worker->slot % sphere->cpu_count]);
+    }
+
+    sphere_drain(worker);
+
+    return NULL;
+}
+
+// expands the prefixes one level at a time until every worker has several
+// subtrees to claim, or the prefixes are leaves
+static void sphere_split(sphere_t* sphere, long thread_max) {
+    sphere_worker_t splitter;
+    sphere_worker_init(&splitter, sphere, 0);
+    splitter.collect = true;
+
+    sphere->prefixes = malloc(sizeof(matrix_t*));
+    sphere->prefixes[0] = matrix_alloc(sphere->dimensions, 1);
+    sphere->prefix_count = 1;
+    sphere->split = sphere->dimensions;
+
+    while (sphere->split > 0 && sphere->prefix_count > 0 && (sphere->split == sphere->dimensions || sphere->prefix_count < SPHERE_PREFIXES_PER_WORKER * thread_max)) {
+        for (long i = 0; i < sphere->prefix_count; ++i) {
+            sphere_resume(&splitter, sphere->prefixes[i], sphere->split, sphere->split - 1);
+            matrix_free(sphere->prefixes[i]);
+        }
+
+        free(sphere->prefixes);
+
+        sphere->prefixes = splitter.collected;
+        sphere->prefix_count = splitter.collected_count;
+        sphere->split -= 1;
+
+        splitter.collected = NULL;
+        splitter.collected_count = 0;
+    }
+
+    sphere->nodes += splitter.nodes;
+    sphere_worker_free(&splitter);
+}
+
+void sphere_enumerate(const matrix_t* basis, const matrix_t* target, mpq_srcptr radius2, const matrix_t* pruning, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out, const enumerate_options_t* options) {
+    assert(matrix_rows(basis) == matrix_cols(basis));
+
+    long dimensions = matrix_rows(basis);
+    sphere_t sphere;
+
+    sphere.dimensions = dimensions;
+    sphere.mu = mpq_array(dimensions * dimensions);
+    sphere.norms = mpq_array(dimensions);
+    sphere.tau = mpq_array(dimensions);
+    sphere.bounds = mpq_array(dimensions);
+    sphere.next = 0;
+    sphere.count = 0;
+    sphere.nodes = 0;
+    sphere.results_out = results_out;
+    sphere.results_count = 0;
+    sphere.output = output;
+    sphere.cpus = options->cpus;
+    sphere.cpu_count = options->cpu_count;
+
+    pthread_mutex_init(&sphere.mutex, NULL);
+
+    sphere_orthogonalize(&sphere, basis, target);
+
+    // level i is fixed with dimensions - i coefficients
+    for (long level = 0; level < dimensions; ++level) {
+        mpq_set(sphere.bounds[level], radius2);
+
+        if (pruning) {
+            mpq_mul(sphere.bounds[level], sphere.bounds[level], matrix_cat(pruning, 0, dimensions - 1 - level));
+        }
+    }
+
+    long thread_max = options->thread_max < 1 ? 1 : options->thread_max;
+
+    if (mpq_sgn(radius2) >= 0) {
+        sphere_split(&sphere, thread_max);
+    } else {
+        sphere.prefixes = NULL;
+        sphere.prefix_count = 0;
+    }
+
+    long worker_count = thread_max < sphere.prefix_count ? thread_max : sphere.prefix_count;
+    sphere_worker_t workers[worker_count > 0 ? worker_count : 1];
+    pthread_t threads[worker_count > 0 ? worker_count : 1];
+    bool started[worker_count > 0 ? worker_count : 1];
+
+    for (long i = 0; i < worker_count; ++i) {
+        sphere_worker_init(&workers[i], &sphere, i);
+    }
+
+    // a single worker runs on the calling thread
+    if (worker_count == 1 && !sphere.cpus) {
+        sphere_thread(&workers[0]);
+    } else {
+        long failed = -1;
+
+        for (long i = 0; i < worker_count; ++i) {
+            started[i] = pthread_create(&threads[i], NULL, sphere_thread, &workers[i]) == 0;
+
+            if (!started[i]) {
+                failed = i;
+            }
+        }
+
+        // the queue is shared, so the caller claims what a missing thread would have
+        if (failed >= 0) {
+            sphere_drain(&workers[failed]);
+        }
+
+        for (long i = 0; i < worker_count; ++i) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+
+    for (long i = 0; i < worker_count; ++i) {
+        sphere_worker_free(&workers[i]);
+    }
+
+    for (long i = 0; i < sphere.prefix_count; ++i) {
+        matrix_free(sphere.prefixes[i]);
+    }
+
+    free(sphere.prefixes);
+
+    *count_out += sphere.count;
+
+    if (stats_out) {
+        stats_out->nodes += sphere.nodes;
+    }
+
+    pthread_mutex_destroy(&sphere.mutex);
+
+    mpq_array_free(sphere.mu, dimensions * dimensions);
+    mpq_array_free(sphere.norms, dimensions);
+    mpq_array_free(sphere.tau, dimensions);
+    mpq_array_free(sphere.bounds, dimensions);
+}
+
+matrix_t* sphere_linear_pruning(long dimensions) {
+    matrix_t* pruning = matrix_alloc(1, dimensions);
+
+    for (long k = 0; k < dimensions; ++k) {
+        mpq_set_ui(matrix_at(pruning, 0, k), k + 1, dimensions);
+        mpq_canonicalize(matrix_at(pruning, 0, k));
+    }
+
+    return pruning;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <gmp.h>
+
+#include "enumerate.h"
+#include "la.h"
+#include "output.h"
+
+// lattice points y with |y - target|^2 <= radius2, found by schnorr-euchner
+// enumeration over the gram-schmidt basis: coefficients are fixed from the
+// last basis vector down, each in zig-zag order around the center its
+// projection puts it at, and a subtree is cut as soon as its projected
+// distance exceeds the bound. target is mpq_t[1][dimensions], or NULL for
+// the origin. points are reported as coefficients, like enumerate().
+//
+// with pruning (mpq_t[1][dimensions]) a node with k + 1 coefficients fixed
+// is cut once its projected distance exceeds pruning[k] * radius2, which
+// misses some points in exchange for a smaller tree; NULL prunes nothing.
+//
+// the subtrees below the first few levels are shared by options->thread_max
+// workers, pinned to options->cpus if given. the pool and objective of the
+// options are not used.
+void sphere_enumerate(const matrix_t* basis, const matrix_t* target, mpq_srcptr radius2, const matrix_t* pruning, long* count_out, matrix_t*** results_out, output_t* output, enumerate_stats_t* stats_out, const enumerate_options_t* options);
+
+// the linear pruning profile (k + 1) / dimensions
+matrix_t* sphere_linear_pruning(long dimensions);
@@ -0,0 +1,207 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gmp.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+typedef struct {
+    const char* name;
+    long start;                // ns since trace_enable()
+    long duration;
+    long lane;                 // worker, or -1 - n for the nth other thread
+    long depth;
+    char* prefix;              // "c0 c1 ...", or NULL
+} trace_event_t;
+
+typedef struct {
+    trace_event_t* events;
+    long count;
+    long capacity;
+} trace_buffer_t;
+
+bool trace_enabled;
+
+static struct timespec origin;
+
+static _Thread_local trace_buffer_t* local;
+static _Thread_local long lane;
+static _Thread_local bool lane_set;
+
+static trace_buffer_t total;
+static long other_lanes;
+static pthread_mutex_t total_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t exit_key;
+static pthread_once_t exit_once = PTHREAD_ONCE_INIT;
+
+static void append(trace_buffer_t* dest, const trace_event_t* events, long count) {
+    if (dest->count + count > dest->capacity) {
+        dest->capacity = 2 * (dest->count + count);
+        dest->events = realloc(dest->events, dest->capacity * sizeof(trace_event_t));
+    }
+
+    memcpy(dest->events + dest->count, events, count * sizeof(trace_event_t));
+    dest->count += count;
+}
+
+static void merge(trace_buffer_t* src) {
+    pthread_mutex_lock(&total_mutex);
+    append(&total, src->events, src->count);
+    pthread_mutex_unlock(&total_mutex);
+
+    src->count = 0;
+}
+
+static void thread_exit(void* data) {
+    trace_buffer_t* buffer = data;
+
+    merge(buffer);
+    free(buffer->events);
+    free(buffer);
+}
+
+static void create_key(void) {
+    pthread_key_create(&exit_key, thread_exit);
+}
+
+void trace_enable(void) {
+    pthread_once(&exit_once, create_key);
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+    trace_enabled = true;
+}
+
+void trace_set_worker(long worker) {
+    lane = worker;
+    lane_set = true;
+}
+
+long trace_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - origin.tv_sec) * 1000000000l + (now.tv_nsec - origin.tv_nsec);
+}
+
+static char* format_prefix(long depth, const matrix_t* prefix) {
+    char* text = NULL;
+    size_t size = 0;
+    FILE* stream = open_memstream(&text, &size);
+
+    for (long row = 0; row < depth; ++row) {
+        if (row > 0) {
+            fputc(' ', stream);
+        }
+
+        mpq_out_str(stream, 10, matrix_cat(prefix, row, 0));
+    }
+
+    fclose(stream);
+
+    return text;
+}
+
+void trace_record(const char* name, long start, long depth, const matrix_t* prefix) {
+    long end = trace_now();
+
+    if (!local) {
+        local = calloc(1, sizeof(trace_buffer_t));
+        pthread_setspecific(exit_key, local);
+    }
+
+    if (!lane_set) {
+        pthread_mutex_lock(&total_mutex);
+        lane = -1 - other_lanes++;
+        pthread_mutex_unlock(&total_mutex);
+
+        lane_set = true;
+    }
+
+    trace_event_t event;
+
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    event.lane = lane;
+    event.depth = depth;
+    event.prefix = prefix ? format_prefix(depth, prefix) : NULL;
+
+    append(local, &event, 1);
+}
+
+void trace_flush(void) {
+    if (local) {
+        merge(local);
+    }
+}
+
+// worker lanes keep their numbers, and the other threads follow them
+static long lane_tid(long lane, long workers) {
+    return lane >= 0 ? lane : workers - 1 - lane;
+}
+
+bool trace_write_json(FILE* dest) {
+    trace_flush();
+    pthread_mutex_lock(&total_mutex);
+
+    long workers = 0;
+
+    for (long i = 0; i < total.count; ++i) {
+        if (total.events[i].lane + 1 > workers) {
+            workers = total.events[i].lane + 1;
+        }
+    }
+
+    fprintf(dest, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+
+    for (long i = 0; i < workers + other_lanes; ++i) {
+        fprintf(dest, "%s\n  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %ld, \"args\": { \"name\": \"%s %ld\" } }", i == 0 ? "" : ",", i, i < workers ? "worker" : "thread", i < workers ? i : i - workers);
+    }
+
+    for (long i = 0; i < total.count; ++i) {
+        const trace_event_t* event = &total.events[i];
+
+        fprintf(dest, "%s\n  { \"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %ld, \"ts\": %ld.%03ld, \"dur\": %ld.%03ld, \"args\": { \"depth\": %ld",
+                workers + other_lanes + i == 0 ? "" : ",", event->name, lane_tid(event->lane, workers),
+                event->start / 1000, event->start % 1000, event->duration / 1000, event->duration % 1000, event->depth);
+
+        if (event->prefix) {
+            fprintf(dest, ", \"prefix\": \"%s\"", event->prefix);
+        }
+
+        fprintf(dest, " } }");
+    }
+
+    fprintf(dest, "\n]}\n");
+
+    pthread_mutex_unlock(&total_mutex);
+
+    return !ferror(dest);
+}
+
+void trace_free(void) {
+    trace_flush();
+    pthread_mutex_lock(&total_mutex);
+
+    for (long i = 0; i < total.count; ++i) {
+        free(total.events[i].prefix);
+    }
+
+    free(total.events);
+    total.events = NULL;
+    total.count = 0;
+    total.capacity = 0;
+
+    pthread_mutex_unlock(&total_mutex);
+
+    if (local) {
+        pthread_setspecific(exit_key, NULL);
+        free(local->events);
+        free(local);
+        local = NULL;
+    }
+}
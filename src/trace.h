@@ -0,0 +1,42 @@
+#pragma once
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "la.h"
+
+// timed spans for a chrome / perfetto timeline, kept per thread and merged
+// when a thread exits or calls trace_flush(). recorded only after
+// trace_enable(), so an untraced run costs one branch per span.
+
+extern bool trace_enabled;
+
+void trace_enable(void);
+
+// puts the calling thread's spans in the lane of worker, rather than in a
+// lane of its own
+void trace_set_worker(long worker);
+
+long trace_now(void);
+void trace_record(const char* name, long start, long depth, const matrix_t* prefix);
+void trace_flush(void);
+
+// every span merged so far, as trace-event json
+bool trace_write_json(FILE* dest);
+
+// drops every span merged so far, and the calling thread's buffer
+void trace_free(void);
+
+// nanoseconds since trace_enable(), for the matching trace_end()
+static inline long trace_begin(void) {
+    return trace_enabled ? trace_now() : 0;
+}
+
+// a span named name from start until now, tagged with depth and the first
+// depth rows of prefix (or none if prefix is NULL)
+static inline void trace_end(const char* name, long start, long depth, const matrix_t* prefix) {
+    if (trace_enabled) {
+        trace_record(name, start, depth, prefix);
+    }
+}
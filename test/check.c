@@ -0,0 +1,635 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "enumerate.h"
+#include "generate.h"
+#include "la.h"
+#include "output.h"
+#include "parse.h"
+
+// regression checks for the enumerator. every way of asking for the points of
+// an instance (results, text and ranges output, the closed-form count, more
+// threads, presolve rows, gomory cuts, batches, updates, and the block path)
+// must agree with one plain search, whose points are each checked to be
+// integer coefficients of a lattice point inside the box and the constraints.
+// the input formats must round-trip. instances come from files, with their
+// known count, or from generate_instance() with fixed seeds.
+
+typedef struct {
+    const char* name;
+    const matrix_t* basis;
+    const matrix_t* lower;
+    const matrix_t* upper;
+    const matrix_t* constraints; // or NULL
+} instance_t;
+
+typedef struct {
+    char** keys; // one line of text output per point, sorted
+    long count;
+} point_set_t;
+
+static long failures = 0;
+
+static void fail(const instance_t* instance, const char* what) {
+    fprintf(stderr, "%s: %s\n", instance->name, what);
+    failures += 1;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+// the point as -f text writes it
+static char* point_key(const matrix_t* point) {
+    size_t size;
+    char* key;
+    FILE* stream = open_memstream(&key, &size);
+
+    for (long i = 0; i < matrix_rows(point); ++i) {
+        gmp_fprintf(stream, i == 0 ? "%Qd" : " %Qd", matrix_cat(point, i, 0));
+    }
+
+    fclose(stream);
+    return key;
+}
+
+static void point_set_sort(point_set_t* set) {
+    qsort(set->keys, set->count, sizeof(char*), compare_keys);
+}
+
+static point_set_t point_set_of(matrix_t** results, long count) {
+    point_set_t set = { malloc((count + 1) * sizeof(char*)), count };
+
+    for (long i = 0; i < count; ++i) {
+        set.keys[i] = point_key(results[i]);
+    }
+
+    point_set_sort(&set);
+    return set;
+}
+
+static void point_set_free(point_set_t* set) {
+    for (long i = 0; i < set->count; ++i) {
+        free(set->keys[i]);
+    }
+
+    free(set->keys);
+}
+
+static bool point_set_equal(const point_set_t* a, const point_set_t* b) {
+    if (a->count != b->count) {
+        return false;
+    }
+
+    for (long i = 0; i < a->count; ++i) {
+        if (strcmp(a->keys[i], b->keys[i]) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void free_results(matrix_t** results, long count) {
+    for (long i = 0; i < count; ++i) {
+        matrix_free(results[i]);
+    }
+
+    free(results);
+}
+
+// the points of [lower, upper] as results. count_out is set to the count the
+// search reported, which must match the number of results.
+static point_set_t collect(const instance_t* instance, lattice_t* lattice, const matrix_t* lower, const matrix_t* upper, long* count_out) {
+    matrix_t** results = NULL;
+    *count_out = 0;
+    lattice_enumerate(lattice, lower, upper, instance->constraints, count_out, &results, NULL, NULL);
+
+    point_set_t set = point_set_of(results, *count_out);
+    free_results(results, *count_out);
+    return set;
+}
+
+// the points of the instance's box as format writes them, one key per point,
+// with a range line expanded into its points
+static point_set_t collect_output(const instance_t* instance, lattice_t* lattice, output_format_t format) {
+    size_t size;
+    char* text;
+    FILE* stream = open_memstream(&text, &size);
+    long count = 0;
+
+    output_t* output = output_alloc(stream, format, matrix_cols(instance->basis));
+    lattice_enumerate(lattice, instance->lower, instance->upper, instance->constraints, &count, NULL, output, NULL);
+    output_free(output);
+    fclose(stream);
+
+    point_set_t set = { NULL, 0 };
+    long capacity = 0;
+
+    mpz_t first, last;
+    mpz_inits(first, last, NULL);
+
+    for (char* line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        char* dots = strstr(line, "..");
+        char* prefix_end = dots ? strrchr(line, ' ') : NULL;
+
+        if (dots) {
+            *dots = '\0';
+            mpz_set_str(first, prefix_end ? prefix_end + 1 : line, 10);
+            mpz_set_str(last, dots + 2, 10);
+        } else {
+            mpz_set_ui(first, 0);
+            mpz_set_ui(last, 0);
+        }
+
+        for (; mpz_cmp(first, last) <= 0; mpz_add_ui(first, first, 1)) {
+            if (set.count == capacity) {
+                capacity = capacity ? 2 * capacity : 64;
+                set.keys = realloc(set.keys, capacity * sizeof(char*));
+            }
+
+            if (dots) {
+                int prefix = prefix_end ? (int) (prefix_end - line + 1) : 0;
+                gmp_asprintf(&set.keys[set.count++], "%.*s%Zd", prefix, line, first);
+            } else {
+                set.keys[set.count++] = strdup(line);
+            }
+        }
+    }
+
+    mpz_clears(first, last, NULL);
+    free(text);
+
+    point_set_sort(&set);
+    return set;
+}
+
+// every point is an integer coefficient vector c whose lattice point
+// y = basis^T c lies in the box and satisfies the constraints
+static void check_points(const instance_t* instance, const point_set_t* set) {
+    long dimensions = matrix_rows(instance->basis);
+    matrix_t* point = matrix_alloc(1, dimensions);
+    matrix_t* y = matrix_alloc(1, dimensions);
+
+    mpq_t product, row;
+    mpq_inits(product, row, NULL);
+
+    for (long p = 0; p < set->count; ++p) {
+        if (!parse_vector(set->keys[p], point)) {
+            fail(instance, "point does not parse");
+            continue;
+        }
+
+        bool valid = true;
+
+        for (long i = 0; i < dimensions; ++i) {
+            valid = valid && mpz_cmp_ui(mpq_denref(matrix_cat(point, 0, i)), 1) == 0;
+        }
+
+        for (long j = 0; j < dimensions; ++j) {
+            mpq_set_ui(matrix_at(y, 0, j), 0, 1);
+
+            for (long i = 0; i < dimensions; ++i) {
+                mpq_mul(product, matrix_cat(instance->basis, i, j), matrix_cat(point, 0, i));
+                mpq_add(matrix_at(y, 0, j), matrix_cat(y, 0, j), product);
+            }
+
+            valid = valid && mpq_cmp(matrix_cat(instance->lower, 0, j), matrix_cat(y, 0, j)) <= 0;
+            valid = valid && mpq_cmp(matrix_cat(y, 0, j), matrix_cat(instance->upper, 0, j)) <= 0;
+        }
+
+        for (long r = 0; instance->constraints && r < matrix_rows(instance->constraints); ++r) {
+            mpq_set_ui(row, 0, 1);
+
+            for (long j = 0; j < dimensions; ++j) {
+                mpq_mul(product, matrix_cat(instance->constraints, r, j), matrix_cat(y, 0, j));
+                mpq_add(row, row, product);
+            }
+
+            valid = valid && mpq_cmp(row, matrix_cat(instance->constraints, r, dimensions)) <= 0;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "%s: point %s is not a lattice point of the query\n", instance->name, set->keys[p]);
+            failures += 1;
+        }
+    }
+
+    mpq_clears(product, row, NULL);
+    matrix_free(point);
+    matrix_free(y);
+}
+
+static bool matrix_equal(const matrix_t* a, const matrix_t* b) {
+    if (!a || !b) {
+        return a == b;
+    }
+
+    if (matrix_rows(a) != matrix_rows(b) || matrix_cols(a) != matrix_cols(b)) {
+        return false;
+    }
+
+    for (long i = 0; i < matrix_rows(a); ++i) {
+        for (long j = 0; j < matrix_cols(a); ++j) {
+            if (!mpq_equal(matrix_cat(a, i, j), matrix_cat(b, i, j))) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// writes the instance in a format and parses it back
+static void check_round_trip(const instance_t* instance, bool binary) {
+    size_t size;
+    char* data;
+    FILE* stream = open_memstream(&data, &size);
+
+    bool written = (binary ? write_binary : write_text)(stream, instance->basis, instance->lower, instance->upper, instance->constraints);
+    fclose(stream);
+
+    matrix_t* basis;
+    matrix_t* lower;
+    matrix_t* upper;
+    matrix_t* constraints;
+
+    if (!written || !parse_buffer(data, size, &basis, &lower, &upper, &constraints)) {
+        fail(instance, binary ? "binary round trip does not parse" : "text round trip does not parse");
+        free(data);
+        return;
+    }
+
+    if (!matrix_equal(basis, instance->basis) || !matrix_equal(lower, instance->lower) || !matrix_equal(upper, instance->upper) || !matrix_equal(constraints, instance->constraints)) {
+        fail(instance, binary ? "binary round trip changes the instance" : "text round trip changes the instance");
+    }
+
+    matrix_free(basis);
+    matrix_free(lower);
+    matrix_free(upper);
+
+    if (constraints) {
+        matrix_free(constraints);
+    }
+
+    free(data);
+}
+
+// the same points from a lattice prepared with other options, both as results
+// and as the closed-form count
+static void check_options(const instance_t* instance, const point_set_t* expected, const enumerate_options_t* options, const char* what) {
+    lattice_t* lattice = lattice_prepare(instance->basis, options);
+    long count;
+
+    point_set_t set = collect(instance, lattice, instance->lower, instance->upper, &count);
+
+    if (!point_set_equal(&set, expected)) {
+        fprintf(stderr, "%s: %s finds %ld points instead of %ld, or others\n", instance->name, what, set.count, expected->count);
+        failures += 1;
+    }
+
+    count = 0;
+    lattice_enumerate(lattice, instance->lower, instance->upper, instance->constraints, &count, NULL, NULL, NULL);
+
+    if (count != expected->count) {
+        fprintf(stderr, "%s: %s counts %ld points instead of %ld\n", instance->name, what, count, expected->count);
+        failures += 1;
+    }
+
+    point_set_free(&set);
+    lattice_free(lattice);
+}
+
+// boxes overlapping the instance's: its lower half along the first
+// coordinate, and the box shifted up by a third of its width there
+static void sub_boxes(const instance_t* instance, matrix_t* lowers[3], matrix_t* uppers[3]) {
+    mpq_t width;
+    mpq_init(width);
+
+    for (long i = 0; i < 3; ++i) {
+        lowers[i] = matrix_dup(instance->lower);
+        uppers[i] = matrix_dup(instance->upper);
+    }
+
+    mpq_sub(width, matrix_cat(instance->upper, 0, 0), matrix_cat(instance->lower, 0, 0));
+
+    mpz_mul_ui(mpq_denref(width), mpq_denref(width), 2);
+    mpq_canonicalize(width);
+    mpq_add(matrix_at(uppers[1], 0, 0), matrix_cat(instance->lower, 0, 0), width);
+
+    mpz_mul_ui(mpq_numref(width), mpq_numref(width), 2);
+    mpz_mul_ui(mpq_denref(width), mpq_denref(width), 3);
+    mpq_canonicalize(width);
+    mpq_add(matrix_at(lowers[2], 0, 0), matrix_cat(lowers[2], 0, 0), width);
+    mpq_add(matrix_at(uppers[2], 0, 0), matrix_cat(uppers[2], 0, 0), width);
+
+    mpq_clear(width);
+}
+
+// a batch of the boxes must report what each box reports alone, and updating
+// from one box to another what a search of the new box finds
+static void check_batch_update(const instance_t* instance, lattice_t* lattice) {
+    matrix_t* lowers[3];
+    matrix_t* uppers[3];
+    point_set_t alone[3];
+    matrix_t** results[3] = { NULL, NULL, NULL };
+    lattice_box_t boxes[3];
+
+    sub_boxes(instance, lowers, uppers);
+
+    for (long i = 0; i < 3; ++i) {
+        long count;
+        alone[i] = collect(instance, lattice, lowers[i], uppers[i], &count);
+
+        boxes[i] = (lattice_box_t) { lowers[i], uppers[i], instance->constraints, 0, &results[i], NULL, NULL };
+    }
+
+    lattice_enumerate_batch(lattice, boxes, 3, NULL);
+
+    for (long i = 0; i < 3; ++i) {
+        point_set_t set = point_set_of(results[i], boxes[i].count);
+
+        if (!point_set_equal(&set, &alone[i])) {
+            fprintf(stderr, "%s: batch box %ld finds %ld points instead of %ld, or others\n", instance->name, i, set.count, alone[i].count);
+            failures += 1;
+        }
+
+        point_set_free(&set);
+        free_results(results[i], boxes[i].count);
+    }
+
+    for (long from = 0; from < 3; ++from) {
+        for (long to = 0; to < 3; ++to) {
+            if (from == to) {
+                continue;
+            }
+
+            matrix_t** old_results = NULL;
+            matrix_t** new_results = NULL;
+            long old_count = 0;
+            long new_count = 0;
+
+            lattice_enumerate(lattice, lowers[from], uppers[from], instance->constraints, &old_count, &old_results, NULL, NULL);
+            lattice_enumerate_update(lattice, lowers[from], uppers[from], old_results, old_count, lowers[to], uppers[to], instance->constraints, &new_count, &new_results, NULL, NULL);
+
+            point_set_t set = point_set_of(new_results, new_count);
+
+            if (!point_set_equal(&set, &alone[to])) {
+                fprintf(stderr, "%s: update from box %ld to box %ld finds %ld points instead of %ld, or others\n", instance->name, from, to, set.count, alone[to].count);
+                failures += 1;
+            }
+
+            point_set_free(&set);
+            free_results(old_results, old_count);
+            free_results(new_results, new_count);
+        }
+    }
+
+    for (long i = 0; i < 3; ++i) {
+        point_set_free(&alone[i]);
+        matrix_free(lowers[i]);
+        matrix_free(uppers[i]);
+    }
+}
+
+// returns the instance's count, after checking it against expected unless
+// that is negative
+static long check_instance(const instance_t* instance, long expected) {
+    enumerate_options_t options;
+    enumerate_options_init(&options);
+    options.thread_max = 1;
+
+    lattice_t* lattice = lattice_prepare(instance->basis, &options);
+    long count;
+
+    point_set_t reference = collect(instance, lattice, instance->lower, instance->upper, &count);
+
+    if (count != reference.count) {
+        fail(instance, "count differs from the number of results");
+    }
+
+    if (expected >= 0 && reference.count != expected) {
+        fprintf(stderr, "%s: finds %ld points instead of %ld\n", instance->name, reference.count, expected);
+        failures += 1;
+    }
+
+    check_points(instance, &reference);
+
+    count = 0;
+    lattice_enumerate(lattice, instance->lower, instance->upper, instance->constraints, &count, NULL, NULL, NULL);
+
+    if (count != reference.count) {
+        fprintf(stderr, "%s: closed-form count %ld instead of %ld\n", instance->name, count, reference.count);
+        failures += 1;
+    }
+
+    output_format_t formats[2] = { OUTPUT_TEXT, OUTPUT_RANGES };
+
+    for (long i = 0; i < 2; ++i) {
+        point_set_t set = collect_output(instance, lattice, formats[i]);
+
+        if (!point_set_equal(&set, &reference)) {
+            fail(instance, formats[i] == OUTPUT_TEXT ? "text output differs from the results" : "ranges output differs from the results");
+        }
+
+        point_set_free(&set);
+    }
+
+    check_batch_update(instance, lattice);
+    lattice_free(lattice);
+
+    options.thread_max = 4;
+    check_options(instance, &reference, &options, "4 threads");
+
+    options.thread_max = 1;
+    options.presolve_depth = 2;
+    check_options(instance, &reference, &options, "presolve");
+
+    options.presolve_depth = 0;
+    options.cut_depth = 2;
+    check_options(instance, &reference, &options, "gomory cuts");
+
+    check_round_trip(instance, false);
+    check_round_trip(instance, true);
+
+    count = reference.count;
+    point_set_free(&reference);
+    return count;
+}
+
+static void check_file(const char* path, long expected) {
+    instance_t instance = { path };
+    matrix_t* basis;
+    matrix_t* lower;
+    matrix_t* upper;
+    matrix_t* constraints;
+
+    if (!parse_file(path, &basis, &lower, &upper, &constraints)) {
+        fprintf(stderr, "error parsing file %s\n", path);
+        failures += 1;
+        return;
+    }
+
+    instance.basis = basis;
+    instance.lower = lower;
+    instance.upper = upper;
+    instance.constraints = constraints;
+
+    check_instance(&instance, expected);
+
+    matrix_free(basis);
+    matrix_free(lower);
+    matrix_free(upper);
+
+    if (constraints) {
+        matrix_free(constraints);
+    }
+}
+
+// a constraint through the box's center with small random coefficients, which
+// cuts off about half of it
+static matrix_t* halving_constraint(gmp_randstate_t state, const matrix_t* lower, const matrix_t* upper) {
+    long dimensions = matrix_cols(lower);
+    matrix_t* constraints = matrix_alloc(1, dimensions + 1);
+
+    mpq_t center;
+    mpq_init(center);
+
+    for (long j = 0; j < dimensions; ++j) {
+        mpq_ptr a = matrix_at(constraints, 0, j);
+        mpq_set_si(a, (long) gmp_urandomm_ui(state, 7) - 3, 1);
+
+        mpq_add(center, matrix_cat(lower, 0, j), matrix_cat(upper, 0, j));
+        mpz_mul_ui(mpq_denref(center), mpq_denref(center), 2);
+        mpq_canonicalize(center);
+        mpq_mul(center, center, a);
+        mpq_add(matrix_at(constraints, 0, dimensions), matrix_cat(constraints, 0, dimensions), center);
+    }
+
+    mpq_clear(center);
+    return constraints;
+}
+
+// the block diagonal lattice of two instances in the product of their boxes
+static void block_instance(const instance_t* first, const instance_t* second, matrix_t** basis_out, matrix_t** lower_out, matrix_t** upper_out) {
+    long d1 = matrix_rows(first->basis);
+    long d2 = matrix_rows(second->basis);
+    matrix_t* basis = matrix_alloc(d1 + d2, d1 + d2);
+    matrix_t* lower = matrix_alloc(1, d1 + d2);
+    matrix_t* upper = matrix_alloc(1, d1 + d2);
+
+    for (long i = 0; i < d1 + d2; ++i) {
+        const instance_t* part = i < d1 ? first : second;
+        long offset = i < d1 ? 0 : d1;
+
+        for (long j = 0; j < matrix_rows(part->basis); ++j) {
+            mpq_set(matrix_at(basis, i, offset + j), matrix_cat(part->basis, i - offset, j));
+        }
+
+        mpq_set(matrix_at(lower, 0, i), matrix_cat(part->lower, 0, i - offset));
+        mpq_set(matrix_at(upper, 0, i), matrix_cat(part->upper, 0, i - offset));
+    }
+
+    *basis_out = basis;
+    *lower_out = lower;
+    *upper_out = upper;
+}
+
+// generated instances of two to five dimensions, with and without a
+// constraint, and the block diagonal lattice of two of them
+static void check_generated(unsigned long seeds) {
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+
+    for (unsigned long seed = 1; seed <= seeds; ++seed) {
+        gmp_randseed_ui(state, seed);
+
+        long dimensions = 2 + seed % 4;
+        long bits = seed % 2 ? 8 : 16;
+        char name[64];
+
+        matrix_t* basis[2];
+        matrix_t* lower[2];
+        matrix_t* upper[2];
+        instance_t instances[2];
+        long counts[2];
+
+        for (long i = 0; i < 2; ++i) {
+            generate_instance(state, i == 0 ? dimensions : 2, bits, 100, &basis[i], &lower[i], &upper[i]);
+        }
+
+        for (long i = 0; i < 2; ++i) {
+            snprintf(name, sizeof(name), "seed %lu, %s", seed, i == 0 ? "main" : "second");
+            instances[i] = (instance_t) { name, basis[i], lower[i], upper[i], NULL };
+            counts[i] = check_instance(&instances[i], -1);
+        }
+
+        snprintf(name, sizeof(name), "seed %lu, constrained", seed);
+        matrix_t* constraints = halving_constraint(state, lower[0], upper[0]);
+        instance_t constrained = { name, basis[0], lower[0], upper[0], constraints };
+        check_instance(&constrained, -1);
+        matrix_free(constraints);
+
+        snprintf(name, sizeof(name), "seed %lu, block diagonal", seed);
+        matrix_t* block_basis;
+        matrix_t* block_lower;
+        matrix_t* block_upper;
+        block_instance(&instances[0], &instances[1], &block_basis, &block_lower, &block_upper);
+        instance_t block = { name, block_basis, block_lower, block_upper, NULL };
+        check_instance(&block, counts[0] * counts[1]);
+        matrix_free(block_basis);
+        matrix_free(block_lower);
+        matrix_free(block_upper);
+
+        for (long i = 0; i < 2; ++i) {
+            matrix_free(basis[i]);
+            matrix_free(lower[i]);
+            matrix_free(upper[i]);
+        }
+    }
+
+    gmp_randclear(state);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "usage: %s [-s seeds] [file [count]]\n", name);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    unsigned long seeds = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:")) != -1) {
+        switch (option) {
+            case 's':
+                seeds = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind > 2 || (argc == optind && seeds == 0)) {
+        usage(argv[0]);
+    }
+
+    if (optind < argc) {
+        check_file(argv[optind], optind + 1 < argc ? strtol(argv[optind + 1], NULL, 10) : -1);
+    }
+
+    check_generated(seeds);
+
+    if (failures) {
+        fprintf(stderr, "%ld checks failed\n", failures);
+        return 1;
+    }
+
+    return 0;
+}